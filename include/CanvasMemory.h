@@ -0,0 +1,18 @@
+#ifndef CANVASMEMORY_H
+#define CANVASMEMORY_H
+
+#include <opencv2/core.hpp>
+
+// 画布分配器: 大画布按大页对齐分配并建议内核使用透明大页(Linux), 物理页在各解码线程首次写入时才分配
+cv::MatAllocator *CanvasAllocator();
+
+// 最后一级缓存大小, 无法获取时按32MB
+size_t LastLevelCacheBytes();
+
+// 填充白色背景(所有字节为0xFF), streaming时使用非临时写入, 不占用缓存
+void FillBackground(cv::Mat area, bool streaming);
+
+// 拷贝到画布区域, streaming时使用非临时写入
+void CopyToCanvas(const cv::Mat &src, cv::Mat dst, bool streaming);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+// 命令行入口, ImgStitcher(带参数启动时)和ImgStitcherCli共用
+int RunCommandLine(int argc, char **argv);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef DETECTIONPROFILE_H
+#define DETECTIONPROFILE_H
+
+#include <opencv2/core.hpp>
+#include <string>
+
+// 文本框检测与打码参数, 可由HSVTracker调试后导出(YAML/JSON, 按扩展名区分)
+struct DetectionProfile
+{
+	// HSV阈值(与FindLineEdit一致, 按RGB顺序转换)
+	cv::Scalar hsv_lower{0, 0, 255};
+	cv::Scalar hsv_upper{0, 0, 255};
+	// 宽高比超过该值的轮廓不视为文本框
+	int max_aspect_ratio = 30;
+	// 打码区域, x/y为相对文本框左上角的偏移
+	cv::Rect mosaic{48, 10, 62, 40};
+
+	// 文件中缺少的字段保持默认值
+	bool Load(const std::string &path);
+	bool Save(const std::string &path) const;
+};
+
+#endif
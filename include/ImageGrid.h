@@ -0,0 +1,199 @@
+#ifndef IMAGEGRID_H
+#define IMAGEGRID_H
+
+#include "DetectionProfile.h"
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+constexpr int OFFSET_X_SEQUENCE = 300;
+constexpr int OFFSET_Y_SEQUENCE = 230;
+constexpr int OFFSET_X_DATETIME = 450;
+constexpr int OFFSET_Y_DATETIME = 230;
+constexpr int OFFSET_X_SHADOW = 4;
+constexpr int OFFSET_Y_SHADOW = 4;
+
+// 绘制选项, 在拼接完成后作用于画布上各单元格
+struct OverlayOptions
+{
+	bool sequence = false;
+	bool datetime = false;
+	bool mosaic = false;
+	// 文本框检测与打码参数
+	DetectionProfile profile;
+
+	bool Any() const { return sequence || datetime || mosaic; }
+};
+
+// 网格布局: 单元格大小取最大图片尺寸, 图片在单元格内居中
+struct GridLayout
+{
+	int rows = 0;
+	int cols = 0;
+	int margin = 0;
+	int cell_width = 0;
+	int cell_height = 0;
+
+	// 超出int范围时抛出std::overflow_error
+	cv::Size CanvasSize() const;
+	// 第index个单元格在画布上的区域
+	cv::Rect CellRect(size_t index) const;
+	// 尺寸为image_size的图片在第index个单元格中居中后的区域
+	cv::Rect ImageRect(size_t index, const cv::Size &image_size) const;
+};
+
+// 内存中的已编码图片(例如从stdin读取), 不经过临时文件
+struct EncodedImage
+{
+	// 用于日志和格式判断的名称
+	std::string name;
+	std::vector<uchar> data;
+	// 绘制日期时间时使用(接收时间)
+	std::string date_time;
+};
+
+// 拼接进度: 工作线程只做原子计数, 界面按固定频率采样; 同时作为取消标记
+struct StitchProgress
+{
+	enum Stage
+	{
+		DECODE,
+		ANNOTATE,
+		ENCODE, // 单位为行
+		STAGE_COUNT
+	};
+
+	StitchProgress() { Reset(); }
+	void Reset();
+
+	void SetTotal(Stage stage, size_t total) { m_total[stage].store(total, std::memory_order_relaxed); }
+	void Advance(Stage stage, size_t count = 1) { m_done[stage].fetch_add(count, std::memory_order_relaxed); }
+	size_t Total(Stage stage) const { return m_total[stage].load(std::memory_order_relaxed); }
+	size_t Done(Stage stage) const { return m_done[stage].load(std::memory_order_relaxed); }
+
+	void Cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+	bool Cancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<size_t> m_total[STAGE_COUNT];
+	std::atomic<size_t> m_done[STAGE_COUNT];
+	std::atomic<bool> m_cancelled;
+};
+
+// 取消后由合成函数抛出, 画布随栈展开释放
+class StitchCancelled : public std::runtime_error
+{
+public:
+	StitchCancelled() : std::runtime_error("Stitching cancelled") {}
+};
+
+// 拼接参数
+struct StitchOptions
+{
+	int rows = 0;
+	int cols = 0;
+	int margin = 10;
+	// "-"表示写到stdout
+	std::string output = "stitched_image.png";
+	// 写到stdout时的输出格式
+	std::string format = "png";
+	OverlayOptions overlay;
+	size_t max_per_page = 0;
+	long long max_page_pixels = 0;
+	// 同时合成/编码的页数, 0表示自动
+	int page_jobs = 0;
+
+	size_t PageJobs(size_t pages) const;
+	// 输出格式的扩展名(小写, 带"."), 写到stdout时由format决定
+	std::string OutputExtension() const;
+};
+
+// 分页结果: 每页包含的图片区间[begin, end)
+struct PageRange
+{
+	size_t begin = 0;
+	size_t end = 0;
+
+	size_t Count() const { return end - begin; }
+};
+
+// 是否为支持的图片格式(按扩展名判断)
+bool IsImageFile(const std::string &path);
+
+// 只读取文件头获取图片尺寸(PNG/JPEG), 失败时回退到完整解码
+bool ProbeImageSize(const std::string &path, cv::Size &size);
+bool ProbeImageSize(const std::vector<uchar> &data, cv::Size &size);
+
+// 并行获取所有图片尺寸, 并移除无法读取的图片
+void ProbeImages(std::vector<std::string> &paths, std::vector<cv::Size> &sizes);
+void ProbeImages(std::vector<EncodedImage> &images, std::vector<cv::Size> &sizes);
+
+// 自动裁剪: UNIFORM去掉四周颜色一致的边框, SHARED再去掉所有图片共有的顶部/底部行(状态栏/导航栏)
+enum class AutoCrop
+{
+	NONE,
+	UNIFORM,
+	SHARED
+};
+
+// 从四周向内扫描颜色一致的边框(CV_8UC3), 返回内容区域(整张图片颜色一致时返回整张图片)
+cv::Rect FindContentRect(const cv::Mat &img, int tolerance = 8);
+
+// 并行解码所有图片计算裁剪区域, sizes更新为裁剪后的尺寸
+// 返回值与图片一一对应, 空矩形表示不裁剪
+std::vector<cv::Rect> AutoCropImages(const std::vector<std::string> &paths, std::vector<cv::Size> &sizes, AutoCrop mode);
+std::vector<cv::Rect> AutoCropImages(const std::vector<EncodedImage> &images, std::vector<cv::Size> &sizes, AutoCrop mode);
+
+// 计算网格布局, rows或cols为0时自动计算
+GridLayout ComputeGridLayout(const std::vector<cv::Size> &sizes, int rows, int cols, int margin);
+
+// 按每页最大图片数/最大画布像素数分页, 0表示不限制
+// 行列数固定时每页最多rows * cols张图片
+std::vector<PageRange> SplitPages(const std::vector<cv::Size> &sizes, int rows, int cols, int margin,
+								  size_t max_per_page, long long max_page_pixels);
+
+// 分页输出文件名: out.png -> out_001.png
+std::string PageOutputPath(const std::string &output, size_t page);
+
+// 查找文本框
+bool FindLineEdit(const cv::Mat &img, cv::Rect &rect_target, const DetectionProfile &profile = DetectionProfile());
+
+// 按本地时间格式化为"YYYY-mm-dd HH:MM:SS"
+std::string FormatDateTime(std::time_t time);
+
+// 格式化文件修改时间
+std::string FileDateTime(const std::string &path);
+
+// origin: 原图左上角相对img的位置, 裁剪后为负, 文字随内容平移且不超出img上边/左边
+void DrawSequence(cv::Mat &img, const int index, const cv::Point &origin = cv::Point());
+void DrawDateTime(cv::Mat &img, const std::string &dateTime, const cv::Point &origin = cv::Point());
+void DrawMosaic(cv::Mat &img, const cv::Rect &rect_target, const DetectionProfile &profile = DetectionProfile());
+
+// 在画布的单元格区域上绘制序号/日期时间/马赛克, name用于日志
+void AnnotateCell(cv::Mat &cell, int index, const std::string &name, const std::string &date_time, const OverlayOptions &options,
+				  const cv::Point &origin = cv::Point());
+
+// 逐行将图片直接解码到画布上, 并在解码后续行的同时对已完成的行进行绘制
+// first_index: 第一张图片的序号偏移
+// progress: 解码/绘制进度, 取消后抛出StitchCancelled
+// crops: AutoCropImages的结果, 解码后只拷贝裁剪区域
+cv::Mat ComposeImageGrid(const std::vector<std::string> &paths,
+						 const std::vector<cv::Size> &sizes,
+						 const GridLayout &layout,
+						 const OverlayOptions &options,
+						 int first_index = 0,
+						 StitchProgress *progress = nullptr,
+						 const std::vector<cv::Rect> &crops = {});
+// 从内存中的已编码数据解码
+cv::Mat ComposeImageGrid(const std::vector<EncodedImage> &images,
+						 const std::vector<cv::Size> &sizes,
+						 const GridLayout &layout,
+						 const OverlayOptions &options,
+						 int first_index = 0,
+						 StitchProgress *progress = nullptr,
+						 const std::vector<cv::Rect> &crops = {});
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "ImageGrid.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 分片拼接: 多个进程各自渲染一段连续的网格行并写入分片文件, 最后合并为一张PNG(或每个分片一张)
+// 分片目录中保存清单(manifest.yml)、检测参数(profile.yml)和各分片文件(band_NNN.band)
+
+// 分片清单: 由协调进程写入, 分片进程和合并步骤读取, 保证所有进程使用相同的图片顺序和布局
+struct ShardManifest
+{
+	std::vector<std::string> paths;
+	std::vector<cv::Size> sizes;
+	// 自动裁剪区域, 未裁剪时为空
+	std::vector<cv::Rect> crops;
+	GridLayout layout;
+	OverlayOptions overlay;
+	int shards = 1;
+	// 分片进程直接输出压缩后的PNG行数据, 合并时只拼接
+	bool deflate = false;
+	// 每次分片运行唯一(清单内容的哈希加上创建时间), 写入每个分片文件, 合并时拒绝其他运行遗留的分片
+	uint64_t run_id = 0;
+
+	// 在Save之前由协调进程调用
+	void AssignRunId();
+
+	// 第shard个分片负责的网格行[start, end)
+	cv::Range Rows(int shard) const;
+	// 第shard个分片在画布上的行区间(不含分片之间的间距)
+	cv::Range CanvasRows(int shard) const;
+
+	bool Save(const std::string &dir) const;
+	bool Load(const std::string &dir);
+};
+
+std::string BandPath(const std::string &dir, int shard);
+
+// 渲染一个分片并写入分片文件, 先写临时文件再重命名, 中途失败不会留下不完整的分片
+bool RenderShard(const ShardManifest &manifest, const std::string &dir, int shard);
+
+// 在本机为每个分片启动一个executable进程(--shard i --band-dir dir), 失败的分片单独重试retries次
+bool RunShards(const std::string &executable, const ShardManifest &manifest, const std::string &dir, int retries);
+
+// 映射各分片文件并合并, 不重新解码图片; tiles为true时每个分片输出一张PNG(PageOutputPath命名)
+// output为"-"时写到stdout
+bool MergeShards(const ShardManifest &manifest, const std::string &dir, const std::string &output, bool tiles);
+
+// 删除清单和分片文件, 目录为空时一并删除
+void RemoveShardFiles(const ShardManifest &manifest, const std::string &dir);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef STITCHPLAN_H
+#define STITCHPLAN_H
+
+#include "ImageGrid.h"
+#include <string>
+#include <vector>
+
+// 耗时/体积模型: 按每百万像素计算, 默认值为典型手机截图的经验值, 可用Calibrate在本机测量
+struct CostModel
+{
+	double decode_png_ms_per_mp = 10.0;
+	double decode_jpeg_ms_per_mp = 6.0;
+	double encode_png_ms_per_mp = 30.0;
+	double encode_jpeg_ms_per_mp = 8.0;
+	// 文本框检测(颜色过滤+边缘检测+轮廓)
+	double detect_ms_per_mp = 8.0;
+	double png_bytes_per_pixel = 0.6;
+	double jpeg_bytes_per_pixel = 0.25;
+	bool calibrated = false;
+
+	// 用合成的截图样式图片测量本机的编解码速度
+	static CostModel Calibrate();
+};
+
+// 拼接前的预估结果, 只依赖图片文件头
+struct StitchPlan
+{
+	struct Page
+	{
+		PageRange range;
+		GridLayout layout;
+		std::string output;
+	};
+
+	size_t images = 0;
+	size_t unreadable = 0;
+	double input_megapixels = 0;
+	std::vector<Page> pages;
+	size_t page_jobs = 1;
+	int threads = 1;
+	double canvas_megapixels = 0;
+	// 各线程的文件读取缓冲
+	size_t buffer_bytes = 0;
+	// 整个运行期间保留在内存中的已编码图片(stdin图片流)
+	size_t input_bytes = 0;
+	// 各线程同时解码的图片(以最大的图片计), 绘制马赛克时加上检测用的灰度/边缘图等中间结果
+	size_t working_bytes = 0;
+	// 同时处理的画布 + 缓冲 + 内存中的图片 + 各线程的解码/检测内存
+	size_t peak_memory_bytes = 0;
+	double decode_ms = 0;
+	double annotate_ms = 0;
+	double encode_ms = 0;
+	size_t output_bytes = 0;
+	// 指定了自动裁剪但未计入(裁剪需要完整解码), 实际画布会更小
+	bool autocrop_excluded = false;
+	CostModel model;
+
+	double TotalMs() const { return decode_ms + annotate_ms + encode_ms; }
+	std::string ToJson() const;
+};
+
+// paths/sizes为ProbeImages的结果, unreadable为被移除的图片数量
+// frame_bytes为从stdin读入内存的各图片大小(与paths对应), 非空时paths只是名称, 不读取文件大小
+StitchPlan PlanStitch(const std::vector<std::string> &paths,
+					  const std::vector<cv::Size> &sizes,
+					  const StitchOptions &options,
+					  const CostModel &model,
+					  size_t unreadable = 0,
+					  const std::vector<size_t> &frame_bytes = {});
+
+// 预估内存超出max_memory_bytes时依次降低并行页数、按像素分页; 单张图片即超出或输出到stdout(不能分页)时返回false
+bool FitToMemory(const std::vector<std::string> &paths,
+				 const std::vector<cv::Size> &sizes,
+				 StitchOptions &options,
+				 const CostModel &model,
+				 size_t max_memory_bytes,
+				 const std::vector<size_t> &frame_bytes = {});
+
+#endif
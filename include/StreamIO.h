@@ -0,0 +1,52 @@
+#ifndef STREAMIO_H
+#define STREAMIO_H
+
+#include "ImageGrid.h"
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Windows下将stdin/stdout切换为二进制模式, 避免换行符被转换
+void SetBinaryMode(std::FILE *file);
+
+// 读取带长度前缀的图片流: 每帧为4字节大端长度 + 已编码的图片数据, 直到流结束
+bool ReadImageFrames(std::FILE *in, std::vector<EncodedImage> &images);
+
+// 读取以'\0'分隔的路径列表(find -print0 的输出格式)
+std::vector<std::string> ReadPathList(std::FILE *in);
+
+// 编码并写入已打开的流, ext为".png"/".jpg"
+// PNG逐行压缩并按块写出, 不在内存中保留完整的编码结果, 每行更新一次编码进度, 取消后返回false
+bool WriteImage(const cv::Mat &img, const std::string &ext, std::FILE *out,
+				StitchProgress *progress = nullptr, int png_compression = 1);
+
+// 打开文件(路径为UTF-8)交给write写入, write返回false或写入失败时删除不完整的文件
+bool WriteToFile(const std::string &path, const std::function<bool(std::FILE *)> &write);
+
+// 编码并保存到文件(路径为UTF-8), 失败或取消时删除不完整的文件
+bool SaveImage(const std::string &path, const cv::Mat &img,
+			   StitchProgress *progress = nullptr, int png_compression = 1);
+
+// 将多段依次相接、宽度相同的行编码为一张PNG(例如映射到内存的分片), 不拼接为整张画布
+bool WritePngRows(const std::vector<cv::Mat> &parts, std::FILE *out, int png_compression = 1);
+
+// 预压缩的PNG行数据: 滤波后的行经deflate压缩, 以完全刷新结束且不含zlib头尾, 可与其他数据段直接拼接
+struct DeflatedSegment
+{
+	const uchar *data = nullptr;
+	size_t size = 0;
+	// 滤波后(每行含滤波类型字节)的数据长度及其adler32, 用于合并校验和
+	uint64_t raw_bytes = 0;
+	uint32_t adler = 1;
+};
+
+// 压缩CV_8UC3的行并追加到data, segment指向追加的部分(data再次扩容前有效)
+// 第一行不滤波, 不依赖前一段的最后一行
+bool DeflateRows(const cv::Mat &rows, int compression, std::vector<uchar> &data, DeflatedSegment &segment);
+
+// 按顺序拼接数据段写出PNG, 只合并校验和而不重新压缩, height为各段行数之和
+bool WritePngSegments(const std::vector<DeflatedSegment> &segments, int width, int height, std::FILE *out);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef WATCHMODE_H
+#define WATCHMODE_H
+
+#include "ImageGrid.h"
+#include <set>
+#include <string>
+#include <vector>
+
+// 常驻内存的拼接结果: 缓存已解码图片和文本框检测结果, 只重新合成受影响的行
+class LiveSheet
+{
+public:
+	// cols为0时根据图片数量自动计算行列数, 否则列数固定、行数随图片增加
+	LiveSheet(int cols, int margin, const OverlayOptions &overlay, const std::string &output);
+
+	// 新增或修改的图片, 在Flush时解码
+	void Queue(const std::string &path);
+	// 删除的图片
+	void Remove(const std::string &path);
+	bool HasPending() const;
+	// 解码待处理的图片, 重新合成受影响的行并保存
+	bool Flush();
+
+	const std::string &Output() const { return m_output; }
+
+private:
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	struct Entry
+	{
+		std::string path;
+		cv::Mat image;
+		std::string date_time;
+		cv::Rect lineedit;
+	};
+
+	bool LoadEntry(Entry &entry) const;
+	void RecomposeRow(int row);
+	bool Save() const;
+
+	int m_cols;
+	int m_margin;
+	OverlayOptions m_overlay;
+	std::string m_output;
+	std::vector<Entry> m_entries;
+	std::vector<std::string> m_pending;
+	std::set<size_t> m_dirty;
+	size_t m_dirty_from;
+	GridLayout m_layout;
+	cv::Mat m_canvas;
+};
+
+// 监视目录中新增/修改/删除的图片, 防抖后增量更新输出(需要inotify)
+// 建立监视后扫描目录并与已Queue的图片一起完成首次拼接
+bool WatchImages(const std::vector<std::string> &dirs, LiveSheet &sheet, int debounce_ms);
+
+#endif
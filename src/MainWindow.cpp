@@ -1,4 +1,5 @@
 #include "MainWindow.h"
+#include "StreamIO.h"
 #include <QVBoxLayout>
 #include <QFormLayout>
 #include <QHBoxLayout>
@@ -8,9 +9,11 @@
 #include <QSpacerItem>
 #include <QDateTime>
 #include <QStandardPaths>
+#include <algorithm>
+#include <iterator>
 
 MainWindow::MainWindow(QWidget *parent)
-    : QWidget(parent), m_step(0)
+    : QWidget(parent)
 {
     QFormLayout *fLayout = new QFormLayout();
     fLayout->setContentsMargins(30, 30, 30, 30);
@@ -67,6 +70,12 @@ MainWindow::MainWindow(QWidget *parent)
     m_checkbox_compress->setChecked(true);
     fLayout->addWidget(m_checkbox_compress);
 
+    m_pushbutton_profile = new QPushButton(this);
+    m_pushbutton_profile->setText("默认");
+    m_pushbutton_profile->setToolTip("加载HSVTracker导出的检测配置");
+    connect(m_pushbutton_profile, &QPushButton::clicked, this, &MainWindow::LoadProfile);
+    fLayout->addRow("检测配置:", m_pushbutton_profile);
+
     QHBoxLayout *hLayout_pushbutton = new QHBoxLayout();
     hLayout_pushbutton->setContentsMargins(0, 0, 0, 0);
     hLayout_pushbutton->setSpacing(10);
@@ -79,6 +88,11 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_pushbutton_start, &QPushButton::clicked, this, &MainWindow::Start);
     m_pushbutton_start->setDisabled(true);
     hLayout_pushbutton->addWidget(m_pushbutton_start);
+    m_pushbutton_cancel = new QPushButton(this);
+    m_pushbutton_cancel->setText("取消");
+    connect(m_pushbutton_cancel, &QPushButton::clicked, this, &MainWindow::Cancel);
+    m_pushbutton_cancel->setDisabled(true);
+    hLayout_pushbutton->addWidget(m_pushbutton_cancel);
     fLayout->addRow(hLayout_pushbutton);
 
     QHBoxLayout *hLayout_progress = new QHBoxLayout();
@@ -89,6 +103,8 @@ MainWindow::MainWindow(QWidget *parent)
     m_label_state->setText("准备中...");
     hLayout_progress->addWidget(m_label_state);
     m_progressbar = new QProgressBar(this);
+    m_progressbar->setRange(0, 1000);
+    m_progressbar->setValue(0);
     hLayout_progress->addWidget(m_progressbar);
     fLayout->addRow(hLayout_progress);
 
@@ -97,109 +113,40 @@ MainWindow::MainWindow(QWidget *parent)
     vLayout->setSpacing(0);
     vLayout->addLayout(fLayout);
 
+    // 按固定频率采样工作线程的进度, 不随图片数量增加信号
+    m_timer = new QTimer(this);
+    m_timer->setInterval(100);
+    connect(m_timer, &QTimer::timeout, this, &MainWindow::UpdateProgress);
+
     connect(this, &MainWindow::sig_finish, this, &MainWindow::slot_finish);
-    connect(this, &MainWindow::sig_update_status, this, &MainWindow::slot_update_status);
-    connect(this, &MainWindow::sig_update_progress, this, &MainWindow::slot_update_progress);
-    connect(this, &MainWindow::sig_set_progress_range, this, &MainWindow::slot_set_progress_range);
     connect(this, &MainWindow::sig_show_message, this, &MainWindow::slot_show_message);
 }
 
-QVector<cv::Mat> MainWindow::LoadImagesFromQStringList(const QStringList &qstringlist)
-{
-    QVector<cv::Mat> images;
-    for (const auto &path : qstringlist)
-    {
-        cv::Mat img = cv::imread(path.toStdString());
-        if (!img.empty())
-        {
-            images.push_back(img);
-        }
-    }
-    return images;
-}
-
-bool MainWindow::FindLineEdit(cv::Mat &img, cv::Rect &rect_target)
+MainWindow::~MainWindow()
 {
-    // 颜色过滤
-    cv::Mat img_hsv, img_mask;
-    cv::cvtColor(img, img_hsv, cv::COLOR_RGB2HSV);
-    cv::inRange(img_hsv, cv::Scalar(0, 0, 255), cv::Scalar(0, 0, 255), img_mask);
-
-    // 二值化处理
-    cv::Mat img_binary;
-    cv::threshold(img_mask, img_binary, 200, 255, cv::THRESH_BINARY);
-
-    // 边缘检测
-    cv::Mat edges;
-    cv::Canny(img_binary, edges, 50, 150);
-
-    // 查找轮廓
-    std::vector<std::vector<cv::Point>> contours;
-    std::vector<cv::Vec4i> hierarchy;
-    cv::findContours(edges, contours, hierarchy, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-
-    for (int i = 0; i < contours.size(); ++i)
-    {
-        cv::Rect current_rect = cv::boundingRect(contours[i]);
-        // 比例大小筛选
-        if (current_rect.width / current_rect.height > 30)
-        {
-            continue;
-        }
-
-        // 查找宽度最大的
-        if (current_rect.width > rect_target.width)
-        {
-            rect_target = current_rect;
-        }
-    }
-
-    if (rect_target.empty())
+    // 关闭窗口时取消正在进行的拼接
+    m_progress.Cancel();
+    if (m_worker.joinable())
     {
-        return false;
+        m_worker.join();
     }
-    return true;
 }
 
-cv::Mat MainWindow::CreateImageGrid(const QVector<cv::Mat> &images)
+void MainWindow::LoadProfile()
 {
-    int rows = m_lineedit_columns->text().toInt();
-    int cols = m_lineedit_row->text().toInt();
-    // int cols = static_cast<int>(std::ceil(static_cast<double>(m_image_paths.size()) / rows));
-    if (images.empty() || rows * cols < images.size())
+    QString path = QFileDialog::getOpenFileName(nullptr, "选择检测配置", QString(), "检测配置 (*.yml *.yaml *.json);;所有文件 (*)");
+    if (path.isEmpty())
     {
-        QMessageBox::warning(this, "错误", "行数/列数错误", QMessageBox::Ok);
-    }
-
-    int margin = m_lineedit_margin->text().toInt();
-
-    // 获取最大图片的宽度和高度
-    int max_width = 0, max_height = 0;
-    for (const auto &img : images)
-    {
-        max_width = std::max(max_width, img.cols);
-        max_height = std::max(max_height, img.rows);
+        return;
     }
-
-    // 创建空白画布
-    cv::Mat grid(rows * max_height + (rows - 1) * margin, cols * max_width + (cols - 1) * margin, CV_8UC3, cv::Scalar(255, 255, 255));
-
-    // 将图片粘贴到画布上
-    for (size_t i = 0; i < images.size(); ++i)
+    DetectionProfile profile;
+    if (!profile.Load(path.toStdString()))
     {
-        int row = i / cols;
-        int col = i % cols;
-
-        int x = col == 0 ? col * max_width : col * max_width + col * margin;
-        int y = row == 0 ? row * max_height : row * max_height + row * margin;
-
-        int w = images[i].cols;
-        int h = images[i].rows;
-
-        images[i].copyTo(grid(cv::Rect(x + (max_width - w) / 2, y + (max_height - h) / 2, w, h)));
+        QMessageBox::warning(this, "错误", "检测配置读取失败", QMessageBox::Ok);
+        return;
     }
-
-    return grid;
+    m_profile = profile;
+    m_pushbutton_profile->setText(QFileInfo(path).fileName());
 }
 
 void MainWindow::SelectImages()
@@ -218,12 +165,62 @@ void MainWindow::SelectImages()
         m_lineedit_columns->setText(QString::number(static_cast<int>(std::ceil(std::sqrt(m_image_paths.size())))));
         m_lineedit_row->setText(QString::number(static_cast<int>(std::ceil(static_cast<double>(m_image_paths.size()) / m_lineedit_columns->text().toInt()))));
         m_label_state->setText("已选" + QString::number(m_image_paths.size()) + "张图片");
+        ShowPlan(Settings());
         m_pushbutton_start->setDisabled(false);
         return;
     }
     m_pushbutton_start->setDisabled(true);
 }
 
+void MainWindow::ShowPlan(const StitchOptions &settings)
+{
+    // 只读取文件头, 预估画布大小/内存/耗时; 失败时不保留之前的预估
+    m_plan = StitchPlan();
+    std::vector<std::string> paths;
+    for (const QString &path : m_image_paths)
+    {
+        paths.push_back(path.toStdString());
+    }
+    std::vector<cv::Size> sizes;
+    ProbeImages(paths, sizes);
+    if (paths.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        StitchPlan plan = PlanStitch(paths, sizes, settings, CostModel(), m_image_paths.size() - paths.size());
+        m_plan = plan;
+        cv::Size canvas = plan.pages.front().layout.CanvasSize();
+        m_label_state->setText(QString("已选%1张图片, 画布%2×%3, 预计内存%4 MB, 耗时约%5秒")
+                                   .arg(m_image_paths.size())
+                                   .arg(canvas.width)
+                                   .arg(canvas.height)
+                                   .arg(static_cast<qulonglong>(plan.peak_memory_bytes >> 20))
+                                   .arg(plan.TotalMs() / 1000.0, 0, 'f', 1));
+        m_label_state->setToolTip(QString::fromStdString(plan.ToJson()));
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::warn("Failed to plan stitching: {}", e.what());
+    }
+}
+
+StitchOptions MainWindow::Settings() const
+{
+    StitchOptions options;
+    options.rows = m_lineedit_columns->text().toInt();
+    options.cols = m_lineedit_row->text().toInt();
+    options.margin = m_lineedit_margin->text().toInt();
+    options.output = QString(m_fileinfo.absoluteDir().path() + "/" + m_lineedit_filename->text() + "." + m_combobox_format->currentText()).toStdString();
+    options.overlay.sequence = m_checkbox_sequence->isChecked();
+    options.overlay.datetime = m_checkbox_datetime->isChecked();
+    options.overlay.mosaic = m_checkbox_mosaic->isChecked();
+    options.overlay.profile = m_profile;
+    return options;
+}
+
 void MainWindow::Start()
 {
     m_lineedit_margin->setDisabled(true);
@@ -235,158 +232,158 @@ void MainWindow::Start()
     m_checkbox_datetime->setDisabled(true);
     m_checkbox_mosaic->setDisabled(true);
     m_checkbox_compress->setDisabled(true);
+    m_pushbutton_profile->setDisabled(true);
     m_pushbutton_select->setDisabled(true);
     m_pushbutton_start->setDisabled(true);
+    m_pushbutton_cancel->setDisabled(false);
 
-    m_worker = std::thread(&MainWindow::ImageProcessing, this);
+    // 工作线程只使用启动时的设置快照, 不访问界面控件
+    std::vector<std::string> paths;
+    for (const QString &path : m_image_paths)
+    {
+        paths.push_back(path.toStdString());
+    }
+    int png_compression = m_checkbox_compress->isChecked() ? 3 : 1; // 0-9 (0-无压缩但快, 9-最大压缩但慢)
+    // 进度权重使用与工作线程相同的设置重新预估
+    StitchOptions settings = Settings();
+    ShowPlan(settings);
+
+    m_progress.Reset();
+    std::fill(std::begin(m_stage_start), std::end(m_stage_start), -1);
+    m_progressbar->setValue(0);
+    m_label_state->setText("正在读取...");
+    m_elapsed.start();
+    m_timer->start();
+
+    m_worker = std::thread(&MainWindow::ImageProcessing, this, std::move(paths), settings, png_compression);
 }
 
-void MainWindow::DrawSequence(cv::Mat &img, const int index)
+void MainWindow::Cancel()
 {
-    // 设置字体类型、大小、颜色和位置
-    int fontFace = cv::FONT_HERSHEY_DUPLEX;
-    double fontScale = 3; // 字体缩放因子
-    int thickness = 6;    // 线宽
-    // 绘制阴影
-    cv::Scalar color_shadow(255, 255, 255);                                                             // BGR颜色
-    cv::Point textOrg_shadow(OFFSET_X_SEQUENCE + OFFSET_X_SHADOW, OFFSET_Y_SEQUENCE + OFFSET_Y_SHADOW); // 文本起始位置
-    cv::putText(img, std::to_string(index + 1), textOrg_shadow, fontFace, fontScale, color_shadow, thickness, cv::LINE_AA);
-    // 绘制序号
-    cv::Scalar color(0, 0, 255);
-    cv::Point textOrg(OFFSET_X_SEQUENCE, OFFSET_Y_SEQUENCE);
-    cv::putText(img, std::to_string(index + 1), textOrg, fontFace, fontScale, color, thickness, cv::LINE_AA);
+    m_progress.Cancel();
+    m_pushbutton_cancel->setDisabled(true);
+    m_label_state->setText("正在取消...");
 }
 
-void MainWindow::DrawDateTime(cv::Mat &img, const int index)
+void MainWindow::UpdateProgress()
 {
-    QFileInfo currentFile(m_image_paths[index]);
-    std::string dateTime = currentFile.lastModified().toString("yyyy-MM-dd hh:mm:ss").toStdString();
-    int fontFace = cv::FONT_HERSHEY_DUPLEX;
-    double fontScale = 3;
-    int thickness = 6;
-    cv::Scalar color_shadow(255, 255, 255);
-    cv::Point textOrg_shadow(OFFSET_X_DATETIME + OFFSET_X_SHADOW, OFFSET_Y_DATETIME + OFFSET_Y_SHADOW);
-    cv::putText(img, dateTime, textOrg_shadow, fontFace, fontScale, color_shadow, thickness, cv::LINE_AA);
-    cv::Scalar color(243, 150, 33);
-    cv::Point textOrg(OFFSET_X_DATETIME, OFFSET_Y_DATETIME);
-    cv::putText(img, dateTime, textOrg, fontFace, fontScale, color, thickness, cv::LINE_AA);
-}
+    static const char *stage_names[] = {"解码", "绘制", "保存"};
+    static const char *stage_units[] = {"张", "张", "行"};
+    if (m_progress.Cancelled())
+    {
+        return;
+    }
 
-void MainWindow::DrawMosaic(cv::Mat &img, const cv::Rect &rect_target)
-{
-    // cv::rectangle(img, rect_target.tl(), rect_target.br(), cv::Scalar(255, 0, 255), 5);
-    // 截取打码区域
-    int x = rect_target.x + OFFSET_X_MOSAIC;
-    int y = rect_target.y + OFFSET_Y_MOSAIC;
-    int w = WIDTH_MOSAIC;
-    int h = HEIGHT_MOSAIC;
-    cv::Mat img_mosaic = img(cv::Rect(x, y, w, h)).clone();
-    // 打码
-    cv::GaussianBlur(img_mosaic, img_mosaic, cv::Size(25, 25), 0);
-    // 粘贴到原图
-    img_mosaic.copyTo(img(cv::Rect(x, y, w, h)));
+    // 各阶段可能同时进行, 分别计算速度和剩余时间; 总进度按预估耗时加权
+    double weights[] = {m_plan.decode_ms, m_plan.annotate_ms, m_plan.encode_ms};
+    double weight_total = m_plan.TotalMs();
+    if (weight_total <= 0)
+    {
+        std::fill(std::begin(weights), std::end(weights), 1.0);
+        weight_total = StitchProgress::STAGE_COUNT;
+    }
+
+    qint64 now = m_elapsed.elapsed();
+    double finished = 0;
+    QStringList texts;
+    for (int i = 0; i < StitchProgress::STAGE_COUNT; ++i)
+    {
+        auto stage = static_cast<StitchProgress::Stage>(i);
+        size_t total = m_progress.Total(stage);
+        size_t done = std::min(m_progress.Done(stage), total);
+        if (total == 0)
+        {
+            continue;
+        }
+        finished += weights[i] * done / total;
+        if (m_stage_start[i] < 0)
+        {
+            m_stage_start[i] = now;
+        }
+        if (done == total)
+        {
+            texts << QString("%1完成").arg(stage_names[i]);
+            continue;
+        }
+
+        QString text = QString("%1 %2/%3").arg(stage_names[i]).arg(static_cast<qulonglong>(done)).arg(static_cast<qulonglong>(total));
+        double seconds = (now - m_stage_start[i]) / 1000.0;
+        if (done > 0 && seconds > 0)
+        {
+            double rate = done / seconds;
+            text += QString(" %1%2/s 剩余%3s").arg(rate, 0, 'f', 1).arg(stage_units[i]).arg((total - done) / rate, 0, 'f', 0);
+        }
+        texts << text;
+    }
+
+    if (!texts.isEmpty())
+    {
+        m_label_state->setText(texts.join("  "));
+    }
+    m_progressbar->setValue(static_cast<int>(m_progressbar->maximum() * finished / weight_total));
 }
 
-void MainWindow::ImageProcessing()
+void MainWindow::ImageProcessing(std::vector<std::string> paths, StitchOptions options, int png_compression)
 {
-    // 加载图片
-    Q_EMIT sig_update_status("正在读取...");
-    Q_EMIT sig_set_progress_range(0, 1 + m_image_paths.size() + 1); // 加载 + 绘制&拼接 + 保存
-    m_step = 0;
-    QVector<cv::Mat> images = LoadImagesFromQStringList(m_image_paths);
-    Q_EMIT sig_update_progress(++m_step);
-
-    // 处理图片
-    Q_EMIT sig_update_status("正在绘制&拼接...");
-    if (m_checkbox_sequence->isChecked() || m_checkbox_datetime->isChecked() || m_checkbox_mosaic->isChecked())
+    // 读取图片尺寸
+    std::vector<cv::Size> sizes;
+    ProbeImages(paths, sizes);
+
+    try
     {
-        // 查找lineedit
-        for (int i = 0; i < images.size(); ++i)
+        GridLayout layout = ComputeGridLayout(sizes, options.rows, options.cols, options.margin);
+
+        // 解码到画布, 拼接完成后在画布上绘制; 画布在离开作用域时释放
+        cv::Mat img_result = ComposeImageGrid(paths, sizes, layout, options.overlay, 0, &m_progress);
+
+        // 保存拼接后的图片, 逐行编码以便取消
+        if (!SaveImage(options.output, img_result, &m_progress, png_compression))
         {
-            cv::Mat &img = images[i];
-            /*绘制序号*/
-            if (m_checkbox_sequence->isChecked())
-            {
-                DrawSequence(img, i);
-            }
-            /*绘制时间*/
-            if (m_checkbox_datetime->isChecked())
+            if (m_progress.Cancelled())
             {
-                DrawDateTime(img, i);
+                throw StitchCancelled();
             }
-            /*绘制马赛克*/
-            if (m_checkbox_mosaic->isChecked())
-            {
-                cv::Rect rect_target;
-                if (!FindLineEdit(img, rect_target))
-                {
-                    spdlog::error("Failed to find lineedit");
-                }
-                else
-                {
-                    // cv::rectangle(img, rect_target.tl(), rect_target.br(), cv::Scalar(255, 0, 255), 5);
-                    DrawMosaic(img, rect_target);
-                }
-            }
-            Q_EMIT sig_update_progress(++m_step);
+            spdlog::error("Failed to save image");
+            Q_EMIT sig_show_message(false, "保存失败");
+            Q_EMIT sig_finish(false, "保存失败");
+            return;
         }
     }
-
-    // 保存拼接后的图片
-    cv::Mat img_result = CreateImageGrid(images);
-    Q_EMIT sig_update_status("正在保存...");
-    std::string output_file = QString(m_fileinfo.absoluteDir().path() + "/" + m_lineedit_filename->text() + "." + m_combobox_format->currentText()).toStdString();
-    if (m_checkbox_compress->isChecked() && m_combobox_format->currentText() == QString("png"))
+    catch (const StitchCancelled &)
     {
-        CompressAsPNG(img_result, output_file);
+        spdlog::info("Cancelled");
+        Q_EMIT sig_finish(false, "已取消");
         return;
     }
-    if (!cv::imwrite(output_file, img_result))
+    catch (const std::invalid_argument &e)
     {
-        Q_EMIT sig_update_progress(++m_step);
-        spdlog::error("Failed to save image");
-        Q_EMIT sig_show_message(false, "保存失败");
-        Q_EMIT sig_update_status("保存失败");
+        spdlog::error("{}", e.what());
+        Q_EMIT sig_show_message(false, "行数/列数错误");
+        Q_EMIT sig_finish(false, "拼接失败");
+        return;
     }
-    else
+    catch (const std::exception &e)
     {
-        Q_EMIT sig_update_progress(++m_step);
-        spdlog::info("Success");
-        Q_EMIT sig_show_message(true, "文件已保存至: " + QString::fromStdString(output_file));
-        Q_EMIT sig_update_status("保存完成");
+        spdlog::error("Error processing images: {}", e.what());
+        Q_EMIT sig_show_message(false, "拼接失败");
+        Q_EMIT sig_finish(false, "拼接失败");
+        return;
     }
-    Q_EMIT sig_finish();
-}
 
-void MainWindow::CompressAsPNG(const cv::Mat &image, const std::string &outputPath, int compressionLevel)
-{
-    std::vector<int> compression_params;
-    compression_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
-    compression_params.push_back(compressionLevel); // 0-9 (0-无压缩但快, 9-最大压缩但慢)
-
-    if (!cv::imwrite(outputPath, image, compression_params))
-    {
-        Q_EMIT sig_update_progress(++m_step);
-        spdlog::error("Failed to save image");
-        Q_EMIT sig_show_message(false, "保存失败");
-        Q_EMIT sig_update_status("保存失败");
-    }
-    else
-    {
-        Q_EMIT sig_update_progress(++m_step);
-        spdlog::info("Success");
-        Q_EMIT sig_show_message(true, "文件已保存至: " + QString::fromStdString(outputPath));
-        Q_EMIT sig_update_status("保存完成");
-    }
-    Q_EMIT sig_finish();
+    spdlog::info("Success");
+    Q_EMIT sig_show_message(true, "文件已保存至: " + QString::fromStdString(options.output));
+    Q_EMIT sig_finish(true, "保存完成");
 }
 
-void MainWindow::slot_finish()
+void MainWindow::slot_finish(bool success, const QString &status)
 {
     if (m_worker.joinable())
     {
         m_worker.join();
     }
+    m_timer->stop();
+    m_label_state->setText(status);
+    m_progressbar->setValue(success ? m_progressbar->maximum() : 0);
 
     m_lineedit_margin->setDisabled(false);
     m_lineedit_row->setDisabled(false);
@@ -397,23 +394,10 @@ void MainWindow::slot_finish()
     m_checkbox_datetime->setDisabled(false);
     m_checkbox_mosaic->setDisabled(false);
     m_checkbox_compress->setDisabled(m_combobox_format->currentText() == QString("png") ? false : true);
+    m_pushbutton_profile->setDisabled(false);
     m_pushbutton_select->setDisabled(false);
     m_pushbutton_start->setDisabled(false);
-}
-
-void MainWindow::slot_update_status(const QString &text)
-{
-    m_label_state->setText(text);
-}
-
-void MainWindow::slot_update_progress(int value)
-{
-    m_progressbar->setValue(value);
-}
-
-void MainWindow::slot_set_progress_range(int min, int max)
-{
-    m_progressbar->setRange(min, max);
+    m_pushbutton_cancel->setDisabled(true);
 }
 
 void MainWindow::slot_show_message(bool success, const QString &message)
@@ -0,0 +1,7 @@
+#include "CommandLine.h"
+
+// 无Qt/GUI依赖的命令行程序, 启动时只加载OpenCV的core/imgproc/imgcodecs
+int main(int argc, char **argv)
+{
+	return RunCommandLine(argc, argv);
+}
@@ -0,0 +1,234 @@
+#include "CanvasMemory.h"
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CANVAS_STREAMING_STORES 1
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// 小于此大小的画布使用默认分配
+	constexpr size_t LARGE_CANVAS_BYTES = 8u << 20;
+	constexpr size_t HUGE_PAGE_BYTES = 2u << 20;
+	// 每行至少这么多字节才使用非临时写入
+	constexpr size_t MIN_STREAMING_BYTES = 64;
+
+	size_t RoundUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	class CanvasMatAllocator : public cv::MatAllocator
+	{
+	public:
+		cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0, size_t *step,
+							   cv::AccessFlag, cv::UMatUsageFlags) const override
+		{
+			size_t total = CV_ELEM_SIZE(type);
+			for (int i = dims - 1; i >= 0; --i)
+			{
+				if (step)
+				{
+					if (data0 && step[i] != CV_AUTOSTEP)
+					{
+						CV_Assert(total <= step[i]);
+						total = step[i];
+					}
+					else
+					{
+						step[i] = total;
+					}
+				}
+				total *= sizes[i];
+			}
+
+			uchar *data = data0 ? static_cast<uchar *>(data0) : Allocate(total);
+			cv::UMatData *u = new cv::UMatData(this);
+			u->data = u->origdata = data;
+			u->size = total;
+			if (data0)
+			{
+				u->flags |= cv::UMatData::USER_ALLOCATED;
+			}
+			return u;
+		}
+
+		bool allocate(cv::UMatData *u, cv::AccessFlag, cv::UMatUsageFlags) const override
+		{
+			return u != nullptr;
+		}
+
+		void deallocate(cv::UMatData *u) const override
+		{
+			if (!u)
+			{
+				return;
+			}
+			CV_Assert(u->urefcount == 0);
+			CV_Assert(u->refcount == 0);
+			if (!(u->flags & cv::UMatData::USER_ALLOCATED))
+			{
+				Free(u->origdata, u->size);
+				u->origdata = nullptr;
+			}
+			delete u;
+		}
+
+	private:
+		static uchar *Allocate(size_t total)
+		{
+#ifdef __linux__
+			if (total >= LARGE_CANVAS_BYTES)
+			{
+				// 多映射一个大页用于对齐, 再释放首尾多余部分
+				size_t length = RoundUp(total, HUGE_PAGE_BYTES);
+				void *raw = mmap(nullptr, length + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (raw == MAP_FAILED)
+				{
+					throw std::bad_alloc();
+				}
+				uchar *begin = static_cast<uchar *>(raw);
+				uchar *aligned = reinterpret_cast<uchar *>(RoundUp(reinterpret_cast<uintptr_t>(begin), HUGE_PAGE_BYTES));
+				if (aligned > begin)
+				{
+					munmap(begin, aligned - begin);
+				}
+				size_t tail = begin + length + HUGE_PAGE_BYTES - (aligned + length);
+				if (tail > 0)
+				{
+					munmap(aligned + length, tail);
+				}
+#ifdef MADV_HUGEPAGE
+				madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+				return aligned;
+			}
+#endif
+			return static_cast<uchar *>(cv::fastMalloc(total));
+		}
+
+		static void Free(uchar *data, size_t total)
+		{
+#ifdef __linux__
+			if (total >= LARGE_CANVAS_BYTES)
+			{
+				munmap(data, RoundUp(total, HUGE_PAGE_BYTES));
+				return;
+			}
+#endif
+			cv::fastFree(data);
+		}
+	};
+
+	void FillRow(uchar *p, size_t n, bool streaming)
+	{
+#ifdef CANVAS_STREAMING_STORES
+		if (streaming && n >= MIN_STREAMING_BYTES)
+		{
+			size_t head = RoundUp(reinterpret_cast<uintptr_t>(p), 16) - reinterpret_cast<uintptr_t>(p);
+			std::memset(p, 0xFF, head);
+			p += head;
+			n -= head;
+			const __m128i white = _mm_set1_epi8(-1);
+			for (; n >= 16; p += 16, n -= 16)
+			{
+				_mm_stream_si128(reinterpret_cast<__m128i *>(p), white);
+			}
+		}
+#else
+		(void)streaming;
+#endif
+		std::memset(p, 0xFF, n);
+	}
+
+	void CopyRow(const uchar *src, uchar *dst, size_t n, bool streaming)
+	{
+#ifdef CANVAS_STREAMING_STORES
+		if (streaming && n >= MIN_STREAMING_BYTES)
+		{
+			size_t head = RoundUp(reinterpret_cast<uintptr_t>(dst), 16) - reinterpret_cast<uintptr_t>(dst);
+			std::memcpy(dst, src, head);
+			src += head;
+			dst += head;
+			n -= head;
+			for (; n >= 16; src += 16, dst += 16, n -= 16)
+			{
+				_mm_stream_si128(reinterpret_cast<__m128i *>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+			}
+		}
+#else
+		(void)streaming;
+#endif
+		std::memcpy(dst, src, n);
+	}
+
+	// 非临时写入不保证对其他线程可见的顺序, 写完后需要屏障
+	void StreamingFence(bool streaming)
+	{
+#ifdef CANVAS_STREAMING_STORES
+		if (streaming)
+		{
+			_mm_sfence();
+		}
+#else
+		(void)streaming;
+#endif
+	}
+}
+
+cv::MatAllocator *CanvasAllocator()
+{
+	// 不析构, 保证程序退出时仍存活的画布可以正常释放
+	static CanvasMatAllocator *allocator = new CanvasMatAllocator();
+	return allocator;
+}
+
+size_t LastLevelCacheBytes()
+{
+	static const size_t bytes = []() -> size_t
+	{
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_SIZE)
+		long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+		if (l3 > 0)
+		{
+			return static_cast<size_t>(l3);
+		}
+		long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		if (l2 > 0)
+		{
+			return static_cast<size_t>(l2);
+		}
+#endif
+		return 32u << 20;
+	}();
+	return bytes;
+}
+
+void FillBackground(cv::Mat area, bool streaming)
+{
+	size_t row_bytes = area.cols * area.elemSize();
+	for (int y = 0; y < area.rows; ++y)
+	{
+		FillRow(area.ptr<uchar>(y), row_bytes, streaming);
+	}
+	StreamingFence(streaming);
+}
+
+void CopyToCanvas(const cv::Mat &src, cv::Mat dst, bool streaming)
+{
+	CV_Assert(src.size() == dst.size() && src.type() == dst.type());
+	size_t row_bytes = src.cols * src.elemSize();
+	for (int y = 0; y < src.rows; ++y)
+	{
+		CopyRow(src.ptr<uchar>(y), dst.ptr<uchar>(y), row_bytes, streaming);
+	}
+	StreamingFence(streaming);
+}
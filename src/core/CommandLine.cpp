@@ -0,0 +1,514 @@
+#include "CommandLine.h"
+#include "ImageGrid.h"
+#include "WatchMode.h"
+#include "StitchPlan.h"
+#include "StreamIO.h"
+#include "Shard.h"
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <opencv2/imgcodecs.hpp>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <atomic>
+#include <thread>
+#include <iostream>
+#include <cxxopts.hpp> // 命令行参数解析库
+
+namespace fs = std::filesystem;
+
+// 收集目录或文件列表中的所有图片路径
+std::vector<std::string> CollectImagePaths(const std::vector<std::string> &inputs)
+{
+	std::vector<std::string> imagePaths;
+
+	for (const auto &input : inputs)
+	{
+		if (fs::is_directory(input))
+		{
+			// 处理目录
+			for (const auto &entry : fs::directory_iterator(input))
+			{
+				if (entry.is_regular_file() && IsImageFile(entry.path().string()))
+				{
+					imagePaths.push_back(entry.path().string());
+				}
+			}
+		}
+		else if (fs::is_regular_file(input))
+		{
+			// 处理单个文件
+			if (IsImageFile(input))
+			{
+				imagePaths.push_back(input);
+			}
+		}
+	}
+
+	return imagePaths;
+}
+
+// 当前程序的路径, 用于启动分片进程
+std::string SelfExecutable(const char *argv0)
+{
+#ifdef __linux__
+	std::error_code ec;
+	fs::path self = fs::read_symlink("/proc/self/exe", ec);
+	if (!ec)
+	{
+		return self.string();
+	}
+#endif
+	return argv0;
+}
+
+// 一页图片的裁剪区域, 未裁剪时为空
+std::vector<cv::Rect> PageCrops(const std::vector<cv::Rect> &crops, const PageRange &page)
+{
+	if (crops.empty())
+	{
+		return {};
+	}
+	return std::vector<cv::Rect>(crops.begin() + page.begin, crops.begin() + page.end);
+}
+
+// 合成一页: 参数为页内图片区间、尺寸和布局
+using ComposePage = std::function<cv::Mat(const PageRange &, const std::vector<cv::Size> &, const GridLayout &)>;
+
+// 合成并保存一页
+bool ProcessPage(const std::vector<cv::Size> &sizes,
+				 const PageRange &page,
+				 const StitchOptions &options,
+				 const std::string &outputPath,
+				 const ComposePage &compose)
+{
+	std::vector<cv::Size> page_sizes(sizes.begin() + page.begin, sizes.begin() + page.end);
+
+	// 计算布局(自动计算行列数)
+	GridLayout layout = ComputeGridLayout(page_sizes, options.rows, options.cols, options.margin);
+	if (options.rows <= 0 || options.cols <= 0)
+	{
+		spdlog::info("Auto calculated rows: {}, cols: {}", layout.rows, layout.cols);
+	}
+
+	// 解码到画布并绘制序号/日期时间/马赛克, 序号跨页连续
+	cv::Mat grid = compose(page, page_sizes, layout);
+
+	// 保存结果, "-"时编码后直接写到stdout
+	bool to_stdout = outputPath == "-";
+	spdlog::info("Saving result to: {}", to_stdout ? "stdout" : outputPath);
+	if (to_stdout ? !WriteImage(grid, options.OutputExtension(), stdout) : !cv::imwrite(outputPath, grid))
+	{
+		spdlog::error("Failed to save image to {}", to_stdout ? "stdout" : outputPath);
+		return false;
+	}
+	spdlog::info("Successfully processed and saved image to {}", to_stdout ? "stdout" : outputPath);
+	return true;
+}
+
+// 核心图片处理函数, sizes为ProbeImages的结果
+bool ProcessImages(const std::vector<cv::Size> &sizes, const StitchOptions &options, const ComposePage &compose)
+{
+	try
+	{
+		// 1. 分页
+		std::vector<PageRange> pages = SplitPages(sizes, options.rows, options.cols, options.margin,
+												  options.max_per_page, options.max_page_pixels);
+		if (pages.size() == 1)
+		{
+			return ProcessPage(sizes, pages.front(), options, options.output, compose);
+		}
+		if (options.output == "-")
+		{
+			spdlog::error("Cannot write {} pages to stdout, specify an output file", pages.size());
+			return false;
+		}
+
+		// 2. 多页并行合成与编码, 同时处理的页数决定内存上限
+		size_t jobs = options.PageJobs(pages.size());
+		spdlog::info("Splitting {} images into {} pages, {} pages at a time", sizes.size(), pages.size(), jobs);
+
+		std::atomic<size_t> next_page{0};
+		std::atomic<bool> success{true};
+		auto worker = [&]()
+		{
+			for (size_t page = next_page++; page < pages.size(); page = next_page++)
+			{
+				try
+				{
+					if (!ProcessPage(sizes, pages[page], options, PageOutputPath(options.output, page), compose))
+					{
+						success = false;
+					}
+				}
+				catch (const std::exception &e)
+				{
+					spdlog::error("Error processing page {}: {}", page + 1, e.what());
+					success = false;
+				}
+			}
+		};
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < jobs; ++i)
+		{
+			workers.emplace_back(worker);
+		}
+		worker();
+		for (auto &thread : workers)
+		{
+			thread.join();
+		}
+		return success;
+	}
+	catch (const std::exception &e)
+	{
+		spdlog::error("Error processing images: {}", e.what());
+		return false;
+	}
+}
+
+int RunCommandLine(int argc, char **argv)
+{
+	// 日志写到stderr, stdout留给--plan等机器可读的输出
+	spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+	spdlog::set_level(spdlog::level::debug);
+
+	try
+	{
+		// 1. 解析命令行参数
+		cxxopts::Options options(argv[0], "Image stitching and processing tool");
+		options.add_options()
+			("i,input", "Input files or directories", cxxopts::value<std::vector<std::string>>())
+			("r,rows", "Number of rows (0 for auto)", cxxopts::value<int>()->default_value("0"))
+			("c,cols", "Number of columns (0 for auto)", cxxopts::value<int>()->default_value("0"))
+			("m,margin", "Margin between images", cxxopts::value<int>()->default_value("10"))
+			("o,output", "Output file path, - for stdout", cxxopts::value<std::string>()->default_value("stitched_image.png"))
+			("f,format", "Output format when writing to stdout (png/jpg)", cxxopts::value<std::string>()->default_value("png"))
+			("stdin", "Read length-prefixed images (frames) or a NUL-separated path list (paths) from stdin", cxxopts::value<std::string>()->implicit_value("frames"))
+			("s,sequence", "Add sequence numbers")
+			("d,datetime", "Add datetime stamps")
+			("M,mosaic", "Add mosaic effect")
+			("p,profile", "Detection profile exported by HSVTracker (YAML/JSON)", cxxopts::value<std::string>())
+			("max-per-page", "Maximum images per output sheet (0 for unlimited)", cxxopts::value<size_t>()->default_value("0"))
+			("max-page-pixels", "Maximum canvas pixels per output sheet (0 for unlimited)", cxxopts::value<long long>()->default_value("0"))
+			("page-jobs", "Number of sheets processed concurrently (0 for auto)", cxxopts::value<int>()->default_value("0"))
+			("w,watch", "Watch input directories and update the output incrementally")
+			("debounce", "Quiet period in milliseconds before rewriting the output in watch mode", cxxopts::value<int>()->default_value("500"))
+			("autocrop", "Trim uniform borders (uniform), and also rows shared by all images such as status/navigation bars (shared)", cxxopts::value<std::string>()->implicit_value("uniform"))
+			("plan", "Print the predicted layout, memory and time as JSON without stitching")
+			("calibrate", "Measure codec speed on this machine before planning")
+			("max-memory", "Peak memory limit in MB, switches to a lower-memory mode or refuses the job (0 for unlimited)", cxxopts::value<size_t>()->default_value("0"))
+			("shards", "Render with N local worker processes, each writing a band of grid rows, then merge the bands (0 for off)", cxxopts::value<int>()->default_value("0"))
+			("shard", "Render one shard listed in --band-dir, used by --shards and to rerun a failed shard", cxxopts::value<int>())
+			("merge", "Merge the bands in --band-dir into the output without rendering")
+			("band-dir", "Directory for the shard manifest and band files (default: <output>.bands)", cxxopts::value<std::string>())
+			("band-deflate", "Compress bands in the worker processes, merging then only concatenates them")
+			("tiles", "Merge into one PNG per shard instead of a single image")
+			("retries", "Number of times a failed shard is rerun", cxxopts::value<int>()->default_value("1"))
+			("keep-bands", "Keep the band files after a successful merge")
+			("h,help", "Print help");
+
+		// 设置参数解析器允许无选项参数
+		options.allow_unrecognised_options();
+		options.positional_help("[input  files...]");
+
+		// 解析参数
+		auto result = options.parse(argc, argv);
+
+		// 收集输入文件
+		std::vector<std::string> inputs;
+		if (result.count("input"))
+		{
+			inputs = result["input"].as<std::vector<std::string>>();
+		}
+
+		// 收集未标记的参数作为额外的输入文件
+		auto &unmatched = result.unmatched();
+		inputs.insert(inputs.end(), unmatched.begin(), unmatched.end());
+
+		// 2. 处理帮助选项
+		if (result.count("help"))
+		{
+			spdlog::info(options.help());
+			return 0;
+		}
+
+		// 分片进程与合并: 图片和布局均来自分片目录中的清单, 不需要输入参数
+		std::string output = result["output"].as<std::string>();
+		std::string band_dir = result.count("band-dir") ? result["band-dir"].as<std::string>()
+														 : (output == "-" ? std::string("stitched_image") : output) + ".bands";
+		if (result.count("shard") || result.count("merge"))
+		{
+			ShardManifest manifest;
+			if (!manifest.Load(band_dir))
+			{
+				return 1;
+			}
+			if (result.count("shard"))
+			{
+				return RenderShard(manifest, band_dir, result["shard"].as<int>()) ? 0 : 1;
+			}
+			if (!MergeShards(manifest, band_dir, output, result.count("tiles")))
+			{
+				return 1;
+			}
+			if (!result.count("keep-bands"))
+			{
+				RemoveShardFiles(manifest, band_dir);
+			}
+			return 0;
+		}
+
+		// 从stdin读取图片数据(frames)或路径列表(paths)
+		std::string stdin_mode = result.count("stdin") ? result["stdin"].as<std::string>() : std::string();
+		bool stdin_frames = stdin_mode == "frames";
+		if (stdin_mode == "paths")
+		{
+			SetBinaryMode(stdin);
+			std::vector<std::string> listed = ReadPathList(stdin);
+			inputs.insert(inputs.end(), listed.begin(), listed.end());
+		}
+		else if (!stdin_mode.empty() && !stdin_frames)
+		{
+			spdlog::error("Unknown stdin mode: {}, expected frames or paths", stdin_mode);
+			return 1;
+		}
+		if (result.count("watch") && (stdin_frames || result["output"].as<std::string>() == "-"))
+		{
+			spdlog::error("Watch mode cannot read images from stdin or write to stdout");
+			return 1;
+		}
+		// 监视模式只有按列数增长的单页布局, 不支持的选项直接报错, 不静默忽略
+		if (result.count("watch"))
+		{
+			for (const char *option : {"rows", "autocrop", "max-per-page", "max-page-pixels", "page-jobs",
+									   "plan", "calibrate", "max-memory", "shards"})
+			{
+				if (result.count(option))
+				{
+					spdlog::error("Watch mode cannot be combined with --{}", option);
+					return 1;
+				}
+			}
+		}
+
+		if (inputs.empty() && !stdin_frames)
+		{
+			spdlog::error("No input files specified");
+			spdlog::info(options.help());
+			return 1;
+		}
+
+		// 3. 检查输入参数
+		if (!result.count("input") && stdin_mode.empty())
+		{
+			spdlog::error("No input files or directories specified");
+			spdlog::info(options.help());
+			return 1;
+		}
+
+		// 4. 收集所有图片路径
+		auto imagePaths = CollectImagePaths(inputs);
+
+		if (imagePaths.empty() && !result.count("watch") && !stdin_frames)
+		{
+			spdlog::error("No valid image files found");
+			return 1;
+		}
+
+		// 5. 处理图片
+		StitchOptions stitch;
+		stitch.rows = result["rows"].as<int>();
+		stitch.cols = result["cols"].as<int>();
+		stitch.margin = result["margin"].as<int>();
+		stitch.output = result["output"].as<std::string>();
+		stitch.format = result["format"].as<std::string>();
+		stitch.overlay.sequence = result.count("sequence");
+		stitch.overlay.datetime = result.count("datetime");
+		stitch.overlay.mosaic = result.count("mosaic");
+		if (result.count("profile") && !stitch.overlay.profile.Load(result["profile"].as<std::string>()))
+		{
+			return 1;
+		}
+		stitch.max_per_page = result["max-per-page"].as<size_t>();
+		stitch.max_page_pixels = result["max-page-pixels"].as<long long>();
+		stitch.page_jobs = result["page-jobs"].as<int>();
+
+		// 监视模式: 常驻并增量更新输出
+		if (result.count("watch"))
+		{
+			std::vector<std::string> dirs;
+			for (const auto &input : inputs)
+			{
+				if (fs::is_directory(input))
+				{
+					dirs.push_back(input);
+				}
+				else
+				{
+					spdlog::warn("Not a directory, will not be watched: {}", input);
+				}
+			}
+
+			LiveSheet sheet(stitch.cols, stitch.margin, stitch.overlay, stitch.output);
+			for (const auto &path : imagePaths)
+			{
+				sheet.Queue(path);
+			}
+			return WatchImages(dirs, sheet, result["debounce"].as<int>()) ? 0 : 1;
+		}
+
+		if (stitch.output == "-")
+		{
+			SetBinaryMode(stdout);
+		}
+
+		// 6. 读取图片尺寸(只读取文件头), stdin中的图片保留在内存中直接解码
+		std::vector<std::string> paths = imagePaths;
+		std::vector<EncodedImage> images;
+		std::vector<cv::Size> sizes;
+		size_t received = paths.size();
+		if (stdin_frames)
+		{
+			SetBinaryMode(stdin);
+			if (!ReadImageFrames(stdin, images))
+			{
+				return 1;
+			}
+			received = images.size();
+			ProbeImages(images, sizes);
+			paths.clear();
+			for (const auto &image : images)
+			{
+				paths.push_back(image.name);
+			}
+		}
+		else
+		{
+			ProbeImages(paths, sizes);
+		}
+		if (paths.empty())
+		{
+			spdlog::error("No valid images loaded");
+			return 1;
+		}
+
+		// 7. 自动裁剪(需要解码), 裁剪后的尺寸参与布局; --plan只读取文件头, 不裁剪
+		std::vector<cv::Rect> crops;
+		bool plan_only = result.count("plan");
+		if (result.count("autocrop"))
+		{
+			std::string autocrop = result["autocrop"].as<std::string>();
+			if (autocrop != "uniform" && autocrop != "shared")
+			{
+				spdlog::error("Unknown autocrop mode: {}, expected uniform or shared", autocrop);
+				return 1;
+			}
+			AutoCrop mode = autocrop == "shared" ? AutoCrop::SHARED : AutoCrop::UNIFORM;
+			if (plan_only)
+			{
+				spdlog::warn("Autocrop needs to decode every image, the plan does not include its savings");
+			}
+			else
+			{
+				crops = stdin_frames ? AutoCropImages(images, sizes, mode) : AutoCropImages(paths, sizes, mode);
+			}
+		}
+
+		// 多进程分片: 清单写入分片目录, 各进程渲染一段连续的网格行, 全部成功后合并
+		int shards = result["shards"].as<int>();
+		if (shards > 0 && !plan_only)
+		{
+			if (stdin_frames)
+			{
+				spdlog::error("Shard mode reads images from files, stdin frames are not supported");
+				return 1;
+			}
+			if (SplitPages(sizes, stitch.rows, stitch.cols, stitch.margin, stitch.max_per_page, stitch.max_page_pixels).size() > 1)
+			{
+				spdlog::error("Shard mode writes a single sheet, it cannot be combined with --max-per-page or --max-page-pixels");
+				return 1;
+			}
+
+			ShardManifest manifest;
+			manifest.paths = paths;
+			manifest.sizes = sizes;
+			manifest.crops = crops;
+			manifest.layout = ComputeGridLayout(sizes, stitch.rows, stitch.cols, stitch.margin);
+			manifest.overlay = stitch.overlay;
+			manifest.shards = std::min(shards, manifest.layout.rows);
+			manifest.deflate = result.count("band-deflate");
+			manifest.AssignRunId();
+			spdlog::info("Stitching {} images in {} shards, bands in {}", paths.size(), manifest.shards, band_dir);
+
+			std::error_code ec;
+			fs::create_directories(fs::u8path(band_dir), ec);
+			if (!manifest.Save(band_dir) ||
+				!RunShards(SelfExecutable(argv[0]), manifest, band_dir, result["retries"].as<int>()) ||
+				!MergeShards(manifest, band_dir, output, result.count("tiles")))
+			{
+				return 1;
+			}
+			if (!result.count("keep-bands"))
+			{
+				RemoveShardFiles(manifest, band_dir);
+			}
+			return 0;
+		}
+
+		// 8. 按预估内存调整并行页数/分页
+		CostModel model = result.count("calibrate") ? CostModel::Calibrate() : CostModel();
+		size_t max_memory = result["max-memory"].as<size_t>() << 20;
+		std::vector<size_t> frame_bytes;
+		for (const auto &image : images)
+		{
+			frame_bytes.push_back(image.data.size());
+		}
+		bool fits = max_memory == 0 || FitToMemory(paths, sizes, stitch, model, max_memory, frame_bytes);
+
+		if (plan_only)
+		{
+			StitchPlan plan = PlanStitch(paths, sizes, stitch, model, received - paths.size(), frame_bytes);
+			plan.autocrop_excluded = result.count("autocrop") > 0;
+			std::cout << plan.ToJson() << std::endl;
+			return fits ? 0 : 1;
+		}
+		if (!fits)
+		{
+			return 1;
+		}
+
+		ComposePage compose;
+		if (stdin_frames)
+		{
+			// 各页的图片区间互不重叠, 移出后合成完即释放
+			compose = [&](const PageRange &page, const std::vector<cv::Size> &page_sizes, const GridLayout &layout)
+			{
+				std::vector<EncodedImage> page_images(std::make_move_iterator(images.begin() + page.begin),
+													  std::make_move_iterator(images.begin() + page.end));
+				return ComposeImageGrid(page_images, page_sizes, layout, stitch.overlay, static_cast<int>(page.begin),
+										nullptr, PageCrops(crops, page));
+			};
+		}
+		else
+		{
+			compose = [&](const PageRange &page, const std::vector<cv::Size> &page_sizes, const GridLayout &layout)
+			{
+				std::vector<std::string> page_paths(paths.begin() + page.begin, paths.begin() + page.end);
+				return ComposeImageGrid(page_paths, page_sizes, layout, stitch.overlay, static_cast<int>(page.begin),
+										nullptr, PageCrops(crops, page));
+			};
+		}
+
+		bool success = ProcessImages(sizes, stitch, compose);
+
+		return success ? 0 : 1;
+	}
+	catch (const std::exception &e)
+	{
+		spdlog::error("Error: {}", e.what());
+		return 1;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "DetectionProfile.h"
+#include <spdlog/spdlog.h>
+#include <vector>
+
+namespace
+{
+	void ReadHsv(const cv::FileNode &node, cv::Scalar &hsv)
+	{
+		std::vector<int> values;
+		node >> values;
+		if (values.size() == 3)
+		{
+			hsv = cv::Scalar(values[0], values[1], values[2]);
+		}
+		else if (!node.empty())
+		{
+			spdlog::warn("Expected [h, s, v] for {}", node.name());
+		}
+	}
+
+	void ReadInt(const cv::FileNode &node, int &value)
+	{
+		if (!node.empty())
+		{
+			value = static_cast<int>(node);
+		}
+	}
+}
+
+bool DetectionProfile::Load(const std::string &path)
+{
+	try
+	{
+		cv::FileStorage fs(path, cv::FileStorage::READ);
+		if (!fs.isOpened())
+		{
+			spdlog::error("Failed to open detection profile: {}", path);
+			return false;
+		}
+		ReadHsv(fs["hsv_lower"], hsv_lower);
+		ReadHsv(fs["hsv_upper"], hsv_upper);
+		ReadInt(fs["max_aspect_ratio"], max_aspect_ratio);
+		ReadInt(fs["mosaic_offset_x"], mosaic.x);
+		ReadInt(fs["mosaic_offset_y"], mosaic.y);
+		ReadInt(fs["mosaic_width"], mosaic.width);
+		ReadInt(fs["mosaic_height"], mosaic.height);
+	}
+	catch (const cv::Exception &e)
+	{
+		spdlog::error("Failed to parse detection profile {}: {}", path, e.what());
+		return false;
+	}
+	spdlog::info("Loaded detection profile: {}", path);
+	return true;
+}
+
+bool DetectionProfile::Save(const std::string &path) const
+{
+	try
+	{
+		cv::FileStorage fs(path, cv::FileStorage::WRITE);
+		if (!fs.isOpened())
+		{
+			spdlog::error("Failed to write detection profile: {}", path);
+			return false;
+		}
+		fs << "hsv_lower" << std::vector<int>{static_cast<int>(hsv_lower[0]), static_cast<int>(hsv_lower[1]), static_cast<int>(hsv_lower[2])};
+		fs << "hsv_upper" << std::vector<int>{static_cast<int>(hsv_upper[0]), static_cast<int>(hsv_upper[1]), static_cast<int>(hsv_upper[2])};
+		fs << "max_aspect_ratio" << max_aspect_ratio;
+		fs << "mosaic_offset_x" << mosaic.x;
+		fs << "mosaic_offset_y" << mosaic.y;
+		fs << "mosaic_width" << mosaic.width;
+		fs << "mosaic_height" << mosaic.height;
+	}
+	catch (const cv::Exception &e)
+	{
+		spdlog::error("Failed to write detection profile {}: {}", path, e.what());
+		return false;
+	}
+	spdlog::info("Saved detection profile: {}", path);
+	return true;
+}
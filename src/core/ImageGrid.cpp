@@ -0,0 +1,1010 @@
+#include "ImageGrid.h"
+#include "CanvasMemory.h"
+#include <spdlog/spdlog.h>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	uint16_t ReadUInt16(const unsigned char *p, bool little_endian = false)
+	{
+		return little_endian ? static_cast<uint16_t>(p[0] | (p[1] << 8))
+							 : static_cast<uint16_t>((p[0] << 8) | p[1]);
+	}
+
+	uint32_t ReadUInt32(const unsigned char *p, bool little_endian = false)
+	{
+		return little_endian ? (uint32_t(p[3]) << 24) | (uint32_t(p[2]) << 16) | (uint32_t(p[1]) << 8) | uint32_t(p[0])
+							 : (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+	}
+
+	// 解析APP1段中的EXIF方向标记, 与cv::imread的自动旋转保持一致
+	int ReadExifOrientation(const std::vector<unsigned char> &segment)
+	{
+		if (segment.size() < 14 || std::string(segment.begin(), segment.begin() + 4) != "Exif")
+		{
+			return 1;
+		}
+		const unsigned char *tiff = segment.data() + 6;
+		size_t tiff_size = segment.size() - 6;
+		bool little_endian = tiff[0] == 'I' && tiff[1] == 'I';
+		if (!little_endian && !(tiff[0] == 'M' && tiff[1] == 'M'))
+		{
+			return 1;
+		}
+		uint32_t ifd = ReadUInt32(tiff + 4, little_endian);
+		if (static_cast<size_t>(ifd) + 2 > tiff_size)
+		{
+			return 1;
+		}
+		int count = ReadUInt16(tiff + ifd, little_endian);
+		for (int i = 0; i < count; ++i)
+		{
+			size_t entry = ifd + 2 + static_cast<size_t>(i) * 12;
+			if (entry + 12 > tiff_size)
+			{
+				break;
+			}
+			if (ReadUInt16(tiff + entry, little_endian) == 0x0112)
+			{
+				return ReadUInt16(tiff + entry + 8, little_endian);
+			}
+		}
+		return 1;
+	}
+
+	bool ProbePng(std::istream &in, cv::Size &size)
+	{
+		// 签名之后紧跟IHDR: 长度(4) 类型(4) 宽(4) 高(4)
+		unsigned char ihdr[16];
+		if (!in.read(reinterpret_cast<char *>(ihdr), sizeof(ihdr)) || std::string(ihdr + 4, ihdr + 8) != "IHDR")
+		{
+			return false;
+		}
+		size = cv::Size(static_cast<int>(ReadUInt32(ihdr + 8)), static_cast<int>(ReadUInt32(ihdr + 12)));
+		return size.width > 0 && size.height > 0;
+	}
+
+	bool ProbeJpeg(std::istream &in, cv::Size &size)
+	{
+		int orientation = 1;
+		while (in)
+		{
+			if (in.get() != 0xFF)
+			{
+				return false;
+			}
+			int marker = in.get();
+			while (marker == 0xFF)
+			{
+				marker = in.get();
+			}
+			if (marker == EOF || marker == 0xD9 || marker == 0xDA)
+			{
+				return false;
+			}
+			// 无长度字段的标记
+			if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+			{
+				continue;
+			}
+
+			unsigned char length_bytes[2];
+			if (!in.read(reinterpret_cast<char *>(length_bytes), 2))
+			{
+				return false;
+			}
+			int length = ReadUInt16(length_bytes) - 2;
+			if (length < 0)
+			{
+				return false;
+			}
+
+			bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+			if (sof)
+			{
+				// 精度(1) 高(2) 宽(2)
+				unsigned char frame[5];
+				if (length < 5 || !in.read(reinterpret_cast<char *>(frame), sizeof(frame)))
+				{
+					return false;
+				}
+				size = cv::Size(ReadUInt16(frame + 3), ReadUInt16(frame + 1));
+				if (orientation >= 5 && orientation <= 8)
+				{
+					std::swap(size.width, size.height);
+				}
+				return size.width > 0 && size.height > 0;
+			}
+			if (marker == 0xE1)
+			{
+				std::vector<unsigned char> segment(length);
+				if (!in.read(reinterpret_cast<char *>(segment.data()), length))
+				{
+					return false;
+				}
+				orientation = ReadExifOrientation(segment);
+				continue;
+			}
+			in.seekg(length, std::ios::cur);
+		}
+		return false;
+	}
+
+	size_t DecodeLimit(const char *name, size_t default_value)
+	{
+		const char *value = std::getenv(name);
+		return value ? static_cast<size_t>(std::strtoull(value, nullptr, 10)) : default_value;
+	}
+
+	// 与imread/imdecode的尺寸上限一致(同样可用环境变量调整), 超出时解码必然失败, 不能参与布局
+	bool WithinDecodeLimits(const cv::Size &size)
+	{
+		static const size_t max_width = DecodeLimit("OPENCV_IO_MAX_IMAGE_WIDTH", 1 << 20);
+		static const size_t max_height = DecodeLimit("OPENCV_IO_MAX_IMAGE_HEIGHT", 1 << 20);
+		static const size_t max_pixels = DecodeLimit("OPENCV_IO_MAX_IMAGE_PIXELS", 1 << 30);
+		if (static_cast<size_t>(size.width) > max_width || static_cast<size_t>(size.height) > max_height ||
+			static_cast<size_t>(size.width) * static_cast<size_t>(size.height) > max_pixels)
+		{
+			spdlog::warn("Image header claims {}x{}, exceeding the decoder limits", size.width, size.height);
+			return false;
+		}
+		return true;
+	}
+
+	// 根据文件签名读取PNG/JPEG文件头
+	bool ProbeStream(std::istream &in, cv::Size &size)
+	{
+		unsigned char signature[8] = {};
+		if (!in.read(reinterpret_cast<char *>(signature), 2))
+		{
+			return false;
+		}
+		if (signature[0] == 0x89 && signature[1] == 'P' && in.read(reinterpret_cast<char *>(signature + 2), 6))
+		{
+			return ProbePng(in, size);
+		}
+		if (signature[0] == 0xFF && signature[1] == 0xD8)
+		{
+			return ProbeJpeg(in, size);
+		}
+		return false;
+	}
+
+	// 只读的内存输入流, 不拷贝数据
+	class MemoryBuffer : public std::streambuf
+	{
+	public:
+		explicit MemoryBuffer(const std::vector<uchar> &data)
+		{
+			char *begin = const_cast<char *>(reinterpret_cast<const char *>(data.data()));
+			setg(begin, begin, begin + data.size());
+		}
+
+	protected:
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+		{
+			char *base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+			if (base + off < eback() || base + off > egptr())
+			{
+				return pos_type(off_type(-1));
+			}
+			setg(eback(), base + off, egptr());
+			return pos_type(gptr() - eback());
+		}
+	};
+
+	// 并行获取尺寸, 并移除无法读取的项
+	template <typename T, typename Probe, typename Name>
+	void ProbeAll(std::vector<T> &items, std::vector<cv::Size> &sizes, Probe probe, Name name)
+	{
+		std::vector<cv::Size> probed(items.size());
+		std::vector<char> valid(items.size(), 0);
+		cv::parallel_for_(cv::Range(0, static_cast<int>(items.size())), [&](const cv::Range &range)
+						  {
+							  for (int i = range.start; i < range.end; ++i)
+							  {
+								  valid[i] = probe(items[i], probed[i]);
+							  } });
+
+		std::vector<T> valid_items;
+		sizes.clear();
+		for (size_t i = 0; i < items.size(); ++i)
+		{
+			if (!valid[i])
+			{
+				spdlog::warn("Failed to read image: {}", name(items[i]));
+				continue;
+			}
+			valid_items.push_back(std::move(items[i]));
+			sizes.push_back(probed[i]);
+		}
+		items.swap(valid_items);
+	}
+
+	// 行列数为0时根据图片数量自动计算
+	void GridShape(size_t count, int &rows, int &cols)
+	{
+		if (count > 0 && (rows <= 0 || cols <= 0))
+		{
+			int total = static_cast<int>(count);
+			rows = static_cast<int>(std::ceil(std::sqrt(total)));
+			cols = static_cast<int>(std::ceil(static_cast<double>(total) / rows));
+		}
+	}
+
+	// 读取整个文件
+	bool ReadFileBytes(const std::string &path, std::vector<uchar> &buffer)
+	{
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in)
+		{
+			return false;
+		}
+		std::streamsize size = in.tellg();
+		in.seekg(0, std::ios::beg);
+		buffer.resize(static_cast<size_t>(size));
+		return static_cast<bool>(in.read(reinterpret_cast<char *>(buffer.data()), size));
+	}
+
+	// 将图片直接解码到画布区域中, 避免中间缓冲区
+	bool DecodeInto(const std::vector<uchar> &buffer, const std::string &name, cv::Mat roi, bool streaming)
+	{
+		uchar *target = roi.data;
+		cv::Mat decoded = roi;
+		cv::imdecode(buffer, cv::IMREAD_COLOR, &decoded);
+		if (decoded.empty())
+		{
+			return false;
+		}
+		if (decoded.data == target)
+		{
+			return true;
+		}
+
+		// 解码器重新分配了内存(例如EXIF旋转), 拷贝回画布, 尺寸不一致时其余部分填充背景
+		if (decoded.size() != roi.size())
+		{
+			spdlog::warn("Decoded size {}x{} differs from header size {}x{}: {}",
+						 decoded.cols, decoded.rows, roi.cols, roi.rows, name);
+			FillBackground(roi, streaming);
+		}
+		cv::Rect area(0, 0, std::min(decoded.cols, roi.cols), std::min(decoded.rows, roi.rows));
+		CopyToCanvas(decoded(area), roi(area), streaming);
+		return true;
+	}
+
+	bool DecodeInto(const std::string &path, cv::Mat roi, bool streaming)
+	{
+		std::vector<uchar> buffer;
+		return ReadFileBytes(path, buffer) && DecodeInto(buffer, path, roi, streaming);
+	}
+
+	// 解码后只将裁剪区域拷贝到画布
+	bool DecodeCropped(const std::vector<uchar> &buffer, const cv::Rect &crop, cv::Mat roi, bool streaming)
+	{
+		cv::Mat decoded = cv::imdecode(buffer, cv::IMREAD_COLOR);
+		if (decoded.empty())
+		{
+			return false;
+		}
+		cv::Rect area = crop & cv::Rect(0, 0, decoded.cols, decoded.rows);
+		area.width = std::min(area.width, roi.cols);
+		area.height = std::min(area.height, roi.rows);
+		if (area.size() != roi.size())
+		{
+			FillBackground(roi, streaming);
+		}
+		CopyToCanvas(decoded(area), roi(cv::Rect(0, 0, area.width, area.height)), streaming);
+		return true;
+	}
+
+	// 填充第index个单元格中图片以外的留白, 以及右侧/下方的间距(最后一列/行没有)
+	// 各单元格负责的区域互不重叠且覆盖整个画布, 因此画布不需要整体填充
+	void FillCellGaps(cv::Mat &grid, const GridLayout &layout, size_t index, const cv::Rect &image, bool streaming)
+	{
+		cv::Rect cell = layout.CellRect(index);
+		int right = static_cast<int>(index % layout.cols) + 1 < layout.cols ? layout.margin : 0;
+		int below = static_cast<int>(index / layout.cols) + 1 < layout.rows ? layout.margin : 0;
+		cv::Rect owned(cell.x, cell.y, cell.width + right, cell.height + below);
+
+		cv::Rect gaps[] = {
+			cv::Rect(owned.x, owned.y, owned.width, image.y - owned.y),
+			cv::Rect(owned.x, image.br().y, owned.width, owned.br().y - image.br().y),
+			cv::Rect(owned.x, image.y, image.x - owned.x, image.height),
+			cv::Rect(image.br().x, image.y, owned.br().x - image.br().x, image.height),
+		};
+		for (const auto &gap : gaps)
+		{
+			if (gap.width > 0 && gap.height > 0)
+			{
+				FillBackground(grid(gap), streaming);
+			}
+		}
+	}
+
+	bool NearColor(const uchar *pixel, const cv::Vec3b &color, int tolerance)
+	{
+		return std::abs(pixel[0] - color[0]) <= tolerance && std::abs(pixel[1] - color[1]) <= tolerance &&
+			   std::abs(pixel[2] - color[2]) <= tolerance;
+	}
+
+	// 整行与color的差都不超过tolerance; 整行一次比较, 不逐像素分支, diff为调用方复用的缓冲区
+	bool RowUniform(const cv::Mat &row, const cv::Vec3b &color, int tolerance, cv::Mat &diff)
+	{
+		cv::absdiff(row, cv::Scalar(color[0], color[1], color[2]), diff);
+		return cv::checkRange(diff, true, nullptr, 0, tolerance + 1);
+	}
+
+	// 从行首向后, 与color的差都不超过tolerance的像素数, 最多检查limit个(CV_8UC3的一行)
+	int UniformPrefix(const uchar *row, int limit, const cv::Vec3b &color, int tolerance)
+	{
+		int x = 0;
+		while (x < limit && NearColor(row + x * 3, color, tolerance))
+		{
+			++x;
+		}
+		return x;
+	}
+
+	// 从行尾向前, 与UniformPrefix相同
+	int UniformSuffix(const uchar *row, int cols, int limit, const cv::Vec3b &color, int tolerance)
+	{
+		int n = 0;
+		while (n < limit && NearColor(row + (cols - 1 - n) * 3, color, tolerance))
+		{
+			++n;
+		}
+		return n;
+	}
+
+	// 从上/下开始与参考图片逐行比较, 返回相同的行数(最多max_rows行)
+	int CountSharedRows(const cv::Mat &img, const cv::Mat &reference, int max_rows, bool from_bottom)
+	{
+		if (img.cols != reference.cols)
+		{
+			return 0;
+		}
+		max_rows = std::min({max_rows, img.rows, reference.rows});
+		for (int i = 0; i < max_rows; ++i)
+		{
+			int y = from_bottom ? img.rows - 1 - i : i;
+			int y_ref = from_bottom ? reference.rows - 1 - i : i;
+			if (cv::norm(img.row(y), reference.row(y_ref), cv::NORM_INF) != 0)
+			{
+				return i;
+			}
+		}
+		return max_rows;
+	}
+
+	// 共有行最多占图片高度的比例, 避免裁掉内容相同的整张图片
+	constexpr int SHARED_ROWS_DIVISOR = 4;
+
+	// decode(i)返回第i张图片的完整解码结果
+	std::vector<cv::Rect> AutoCropAll(size_t count, const std::function<cv::Mat(size_t)> &decode,
+									  std::vector<cv::Size> &sizes, AutoCrop mode)
+	{
+		std::vector<cv::Rect> crops(count);
+		if (mode == AutoCrop::NONE || count == 0)
+		{
+			return crops;
+		}
+
+		// 共有行以第一张图片为参考, 只保留参考图片
+		bool shared = mode == AutoCrop::SHARED && count > 1;
+		cv::Mat reference = shared ? decode(0) : cv::Mat();
+		shared = shared && !reference.empty();
+		int max_shared = reference.rows / SHARED_ROWS_DIVISOR;
+
+		std::vector<cv::Rect> content(count);
+		std::vector<int> shared_top(count, max_shared), shared_bottom(count, max_shared);
+		std::vector<cv::Size> full(count);
+		cv::parallel_for_(cv::Range(0, static_cast<int>(count)), [&](const cv::Range &range)
+						  {
+							  for (int i = range.start; i < range.end; ++i)
+							  {
+								  cv::Mat img = i == 0 && shared ? reference : decode(i);
+								  if (img.empty())
+								  {
+									  continue;
+								  }
+								  full[i] = img.size();
+								  content[i] = FindContentRect(img);
+								  if (shared && i > 0)
+								  {
+									  shared_top[i] = CountSharedRows(img, reference, max_shared, false);
+									  shared_bottom[i] = CountSharedRows(img, reference, max_shared, true);
+								  }
+							  } });
+
+		int top = shared ? *std::min_element(shared_top.begin(), shared_top.end()) : 0;
+		int bottom = shared ? *std::min_element(shared_bottom.begin(), shared_bottom.end()) : 0;
+
+		double before = 0, after = 0;
+		size_t trimmed = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (full[i].empty())
+			{
+				continue;
+			}
+			cv::Rect crop = content[i] & cv::Rect(0, top, full[i].width, full[i].height - top - bottom);
+			if (crop.empty())
+			{
+				crop = content[i];
+			}
+			// 空的裁剪区域会被当作不裁剪, 但尺寸已改为0, 图片会消失
+			if (crop.empty())
+			{
+				crop = cv::Rect(cv::Point(), full[i]);
+			}
+			before += full[i].area();
+			after += crop.area();
+			if (crop.size() != full[i])
+			{
+				crops[i] = crop;
+				sizes[i] = crop.size();
+				++trimmed;
+			}
+		}
+		spdlog::info("Autocrop trimmed {} of {} images (shared rows: top {}, bottom {}), {:.1f} MP -> {:.1f} MP",
+					 trimmed, count, top, bottom, before / 1e6, after / 1e6);
+		return crops;
+	}
+
+	// 文字随内容平移, 但不超出图片上边/左边
+	cv::Point TextOrigin(const std::string &text, int fontFace, double fontScale, int thickness, cv::Point org)
+	{
+		int baseline = 0;
+		cv::Size size = cv::getTextSize(text, fontFace, fontScale, thickness, &baseline);
+		return cv::Point(std::max(org.x, 0), std::max(org.y, size.height));
+	}
+
+	// 逐行将图片直接解码到画布上, 并在解码后续行的同时对已完成的行进行绘制
+	// decode: 将第i张图片解码到画布区域, date_time: 第i张图片的日期时间
+	cv::Mat ComposeRows(const std::vector<std::string> &names,
+						const std::vector<cv::Size> &sizes,
+						const GridLayout &layout,
+						const OverlayOptions &options,
+						int first_index,
+						StitchProgress *progress,
+						const std::function<bool(size_t, cv::Mat, bool)> &decode,
+						const std::function<std::string(size_t)> &date_time,
+						const std::vector<cv::Rect> &crops)
+	{
+		// 画布不做整体填充, 解码每个单元格时只填充留白和间距, 每个像素只写一次
+		// 画布超出最后一级缓存时, 拷贝和填充使用非临时写入, 避免挤出解码器正在使用的数据
+		cv::Size canvas_size = layout.CanvasSize();
+		bool streaming = static_cast<size_t>(canvas_size.width) * canvas_size.height * 3 > LastLevelCacheBytes();
+		cv::Mat grid;
+		grid.allocator = CanvasAllocator();
+		grid.create(canvas_size, CV_8UC3);
+
+		auto cancelled = [progress]()
+		{
+			return progress && progress->Cancelled();
+		};
+		if (progress)
+		{
+			progress->SetTotal(StitchProgress::DECODE, names.size());
+			progress->SetTotal(StitchProgress::ANNOTATE, options.Any() ? names.size() : 0);
+		}
+
+		// 每个单元格解码后立即在同一任务中绘制, 绘制只访问本单元格区域, 与其他单元格的解码并行
+		// (不在另一个线程中嵌套cv::parallel_for_, OpenCV会将后进入的并行循环串行执行)
+		auto compose_cells = [&](const cv::Range &range)
+		{
+			for (int i = range.start; i < range.end && !cancelled(); ++i)
+			{
+				cv::Rect image = layout.ImageRect(i, sizes[i]);
+				FillCellGaps(grid, layout, i, image, streaming);
+				if (!decode(i, grid(image), streaming))
+				{
+					spdlog::error("Failed to decode image: {}", names[i]);
+					FillBackground(grid(image), streaming);
+				}
+				spdlog::info("Loaded image: {}", names[i]);
+				if (progress)
+				{
+					progress->Advance(StitchProgress::DECODE);
+				}
+
+				if (options.Any())
+				{
+					cv::Mat cell = grid(image);
+					cv::Point origin = static_cast<size_t>(i) < crops.size() ? -crops[i].tl() : cv::Point();
+					AnnotateCell(cell, first_index + i, names[i], options.datetime ? date_time(i) : std::string(), options, origin);
+					if (progress)
+					{
+						progress->Advance(StitchProgress::ANNOTATE);
+					}
+				}
+			}
+		};
+		cv::parallel_for_(cv::Range(0, static_cast<int>(names.size())), compose_cells);
+		if (cancelled())
+		{
+			throw StitchCancelled();
+		}
+
+		// 末尾的空单元格
+		for (size_t i = names.size(); i < static_cast<size_t>(layout.rows) * layout.cols; ++i)
+		{
+			cv::Rect cell = layout.CellRect(i);
+			FillCellGaps(grid, layout, i, cv::Rect(cell.x, cell.y, 0, 0), streaming);
+		}
+
+		return grid;
+	}
+}
+
+void StitchProgress::Reset()
+{
+	for (int stage = 0; stage < STAGE_COUNT; ++stage)
+	{
+		m_total[stage].store(0, std::memory_order_relaxed);
+		m_done[stage].store(0, std::memory_order_relaxed);
+	}
+	m_cancelled.store(false, std::memory_order_relaxed);
+}
+
+size_t StitchOptions::PageJobs(size_t pages) const
+{
+	size_t jobs = page_jobs > 0 ? static_cast<size_t>(page_jobs)
+								: std::max(1u, std::thread::hardware_concurrency() / 2);
+	return std::max<size_t>(1, std::min(jobs, pages));
+}
+
+std::string StitchOptions::OutputExtension() const
+{
+	std::string ext = output == "-" ? "." + format : fs::path(output).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext;
+}
+
+cv::Size GridLayout::CanvasSize() const
+{
+	long long width = static_cast<long long>(cols) * cell_width + static_cast<long long>(cols - 1) * margin;
+	long long height = static_cast<long long>(rows) * cell_height + static_cast<long long>(rows - 1) * margin;
+	if (width > INT_MAX || height > INT_MAX)
+	{
+		throw std::overflow_error("Canvas size exceeds the supported range");
+	}
+	return cv::Size(static_cast<int>(width), static_cast<int>(height));
+}
+
+cv::Rect GridLayout::CellRect(size_t index) const
+{
+	int row = static_cast<int>(index / cols);
+	int col = static_cast<int>(index % cols);
+	return cv::Rect(col * (cell_width + margin), row * (cell_height + margin), cell_width, cell_height);
+}
+
+cv::Rect GridLayout::ImageRect(size_t index, const cv::Size &image_size) const
+{
+	cv::Rect cell = CellRect(index);
+	return cv::Rect(cell.x + (cell_width - image_size.width) / 2,
+					cell.y + (cell_height - image_size.height) / 2,
+					image_size.width,
+					image_size.height);
+}
+
+bool IsImageFile(const std::string &path)
+{
+	std::string ext = fs::path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == ".jpg" || ext == ".jpeg" || ext == ".png";
+}
+
+bool ProbeImageSize(const std::string &path, cv::Size &size)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (ProbeStream(in, size))
+	{
+		return WithinDecodeLimits(size);
+	}
+
+	// 未知格式, 完整解码
+	cv::Mat img = cv::imread(path);
+	if (img.empty())
+	{
+		return false;
+	}
+	size = img.size();
+	return true;
+}
+
+bool ProbeImageSize(const std::vector<uchar> &data, cv::Size &size)
+{
+	MemoryBuffer buffer(data);
+	std::istream in(&buffer);
+	if (ProbeStream(in, size))
+	{
+		return WithinDecodeLimits(size);
+	}
+
+	cv::Mat img = cv::imdecode(data, cv::IMREAD_COLOR);
+	if (img.empty())
+	{
+		return false;
+	}
+	size = img.size();
+	return true;
+}
+
+void ProbeImages(std::vector<std::string> &paths, std::vector<cv::Size> &sizes)
+{
+	// 只读取文件头, 受磁盘延迟影响, 并行读取
+	ProbeAll(
+		paths, sizes,
+		[](const std::string &path, cv::Size &size)
+		{ return ProbeImageSize(path, size); },
+		[](const std::string &path) -> const std::string &
+		{ return path; });
+}
+
+void ProbeImages(std::vector<EncodedImage> &images, std::vector<cv::Size> &sizes)
+{
+	ProbeAll(
+		images, sizes,
+		[](const EncodedImage &image, cv::Size &size)
+		{ return ProbeImageSize(image.data, size); },
+		[](const EncodedImage &image) -> const std::string &
+		{ return image.name; });
+}
+
+cv::Rect FindContentRect(const cv::Mat &img, int tolerance)
+{
+	if (img.empty())
+	{
+		return cv::Rect();
+	}
+	// 上/左边框以左上角颜色为准, 下/右边框以右下角颜色为准; 上/下边框整行比较, 遇到内容即停止
+	cv::Vec3b top_left = img.at<cv::Vec3b>(0, 0);
+	cv::Vec3b bottom_right = img.at<cv::Vec3b>(img.rows - 1, img.cols - 1);
+	cv::Mat diff;
+	int top = 0, bottom = img.rows;
+	while (top < bottom && RowUniform(img.row(top), top_left, tolerance, diff))
+	{
+		++top;
+	}
+	while (bottom > top && RowUniform(img.row(bottom - 1), bottom_right, tolerance, diff))
+	{
+		--bottom;
+	}
+	if (top == bottom)
+	{
+		return cv::Rect(0, 0, img.cols, img.rows);
+	}
+
+	// 左/右边框宽度为各行行首/行尾相同颜色像素数的最小值, 按行顺序扫描, 每行最多检查到当前的最小值
+	int left = img.cols, right_border = img.cols;
+	for (int y = top; y < bottom && (left > 0 || right_border > 0); ++y)
+	{
+		const uchar *row = img.ptr<uchar>(y);
+		left = UniformPrefix(row, left, top_left, tolerance);
+		right_border = UniformSuffix(row, img.cols, right_border, bottom_right, tolerance);
+	}
+	int right = img.cols - right_border;
+	// 每行都只由两种边框颜色组成(例如左右两半纯色), 不裁剪
+	if (right <= left)
+	{
+		return cv::Rect(0, 0, img.cols, img.rows);
+	}
+	return cv::Rect(left, top, right - left, bottom - top);
+}
+
+std::vector<cv::Rect> AutoCropImages(const std::vector<std::string> &paths, std::vector<cv::Size> &sizes, AutoCrop mode)
+{
+	return AutoCropAll(
+		paths.size(),
+		[&](size_t i)
+		{
+			std::vector<uchar> buffer;
+			return ReadFileBytes(paths[i], buffer) ? cv::imdecode(buffer, cv::IMREAD_COLOR) : cv::Mat();
+		},
+		sizes, mode);
+}
+
+std::vector<cv::Rect> AutoCropImages(const std::vector<EncodedImage> &images, std::vector<cv::Size> &sizes, AutoCrop mode)
+{
+	return AutoCropAll(
+		images.size(),
+		[&](size_t i)
+		{ return cv::imdecode(images[i].data, cv::IMREAD_COLOR); },
+		sizes, mode);
+}
+
+GridLayout ComputeGridLayout(const std::vector<cv::Size> &sizes, int rows, int cols, int margin)
+{
+	GridShape(sizes.size(), rows, cols);
+	if (sizes.empty() || rows <= 0 || cols <= 0 || static_cast<size_t>(rows) * cols < sizes.size())
+	{
+		throw std::invalid_argument("Invalid number of rows or columns");
+	}
+
+	GridLayout layout;
+	layout.rows = rows;
+	layout.cols = cols;
+	layout.margin = margin;
+	for (const auto &size : sizes)
+	{
+		layout.cell_width = std::max(layout.cell_width, size.width);
+		layout.cell_height = std::max(layout.cell_height, size.height);
+	}
+	// 尽早发现过大的画布
+	layout.CanvasSize();
+	return layout;
+}
+
+std::vector<PageRange> SplitPages(const std::vector<cv::Size> &sizes, int rows, int cols, int margin,
+								  size_t max_per_page, long long max_page_pixels)
+{
+	size_t per_page = sizes.size();
+	if (rows > 0 && cols > 0)
+	{
+		per_page = std::min(per_page, static_cast<size_t>(rows) * cols);
+	}
+	if (max_per_page > 0)
+	{
+		per_page = std::min(per_page, max_per_page);
+	}
+
+	std::vector<PageRange> pages;
+	PageRange page;
+	cv::Size cell;
+	for (size_t i = 0; i < sizes.size(); ++i)
+	{
+		cv::Size next_cell(std::max(cell.width, sizes[i].width), std::max(cell.height, sizes[i].height));
+		size_t count = i - page.begin + 1;
+		bool full = count > per_page;
+
+		// 加入当前图片后画布超出像素上限则换页(单张图片独占一页)
+		if (!full && max_page_pixels > 0 && count > 1)
+		{
+			GridLayout layout;
+			layout.rows = rows;
+			layout.cols = cols;
+			GridShape(count, layout.rows, layout.cols);
+			layout.margin = margin;
+			layout.cell_width = next_cell.width;
+			layout.cell_height = next_cell.height;
+			cv::Size canvas = layout.CanvasSize();
+			full = static_cast<long long>(canvas.width) * canvas.height > max_page_pixels;
+		}
+
+		if (full)
+		{
+			page.end = i;
+			pages.push_back(page);
+			page.begin = i;
+			next_cell = sizes[i];
+		}
+		cell = next_cell;
+	}
+	if (page.begin < sizes.size())
+	{
+		page.end = sizes.size();
+		pages.push_back(page);
+	}
+	return pages;
+}
+
+std::string PageOutputPath(const std::string &output, size_t page)
+{
+	fs::path path(output);
+	char suffix[16];
+	std::snprintf(suffix, sizeof(suffix), "_%03zu", page + 1);
+	return (path.parent_path() / (path.stem().string() + suffix + path.extension().string())).string();
+}
+
+bool FindLineEdit(const cv::Mat &img, cv::Rect &rect_target, const DetectionProfile &profile)
+{
+	// 颜色过滤
+	cv::Mat img_hsv, img_mask;
+	cv::cvtColor(img, img_hsv, cv::COLOR_RGB2HSV);
+	cv::inRange(img_hsv, profile.hsv_lower, profile.hsv_upper, img_mask);
+
+	// 二值化处理
+	cv::Mat img_binary;
+	cv::threshold(img_mask, img_binary, 200, 255, cv::THRESH_BINARY);
+
+	// 边缘检测
+	cv::Mat edges;
+	cv::Canny(img_binary, edges, 50, 150);
+
+	// 查找轮廓
+	std::vector<std::vector<cv::Point>> contours;
+	std::vector<cv::Vec4i> hierarchy;
+	cv::findContours(edges, contours, hierarchy, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		cv::Rect current_rect = cv::boundingRect(contours[i]);
+		// 比例大小筛选
+		if (current_rect.width / current_rect.height > profile.max_aspect_ratio)
+		{
+			continue;
+		}
+
+		// 查找宽度最大的
+		if (current_rect.width > rect_target.width)
+		{
+			rect_target = current_rect;
+		}
+	}
+
+	return !rect_target.empty();
+}
+
+std::string FormatDateTime(std::time_t time)
+{
+	// 各单元格并行绘制, 使用可重入版本
+	std::tm tm{};
+#ifdef _WIN32
+	localtime_s(&tm, &time);
+#else
+	localtime_r(&time, &tm);
+#endif
+	char buffer[80];
+	std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+	return std::string(buffer);
+}
+
+std::string FileDateTime(const std::string &path)
+{
+	// 获取文件修改时间
+	auto ftime = fs::last_write_time(path);
+	auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+		ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+	return FormatDateTime(std::chrono::system_clock::to_time_t(sctp));
+}
+
+void DrawSequence(cv::Mat &img, const int index, const cv::Point &origin)
+{
+	int fontFace = cv::FONT_HERSHEY_DUPLEX;
+	double fontScale = 3;
+	int thickness = 6;
+
+	// 绘制阴影
+	cv::Scalar color_shadow(255, 255, 255);
+	std::string text = std::to_string(index + 1);
+	cv::Point textOrg = TextOrigin(text, fontFace, fontScale, thickness, origin + cv::Point(OFFSET_X_SEQUENCE, OFFSET_Y_SEQUENCE));
+	cv::Point textOrg_shadow = textOrg + cv::Point(OFFSET_X_SHADOW, OFFSET_Y_SHADOW);
+	cv::putText(img, text, textOrg_shadow, fontFace, fontScale, color_shadow, thickness, cv::LINE_AA);
+
+	// 绘制序号
+	cv::Scalar color(0, 0, 255);
+	cv::putText(img, text, textOrg, fontFace, fontScale, color, thickness, cv::LINE_AA);
+}
+
+void DrawDateTime(cv::Mat &img, const std::string &dateTime, const cv::Point &origin)
+{
+	int fontFace = cv::FONT_HERSHEY_DUPLEX;
+	double fontScale = 3;
+	int thickness = 6;
+
+	// 绘制阴影
+	cv::Scalar color_shadow(255, 255, 255);
+	cv::Point textOrg = TextOrigin(dateTime, fontFace, fontScale, thickness, origin + cv::Point(OFFSET_X_DATETIME, OFFSET_Y_DATETIME));
+	cv::Point textOrg_shadow = textOrg + cv::Point(OFFSET_X_SHADOW, OFFSET_Y_SHADOW);
+	cv::putText(img, dateTime, textOrg_shadow, fontFace, fontScale, color_shadow, thickness, cv::LINE_AA);
+
+	// 绘制日期时间
+	cv::Scalar color(243, 150, 33);
+	cv::putText(img, dateTime, textOrg, fontFace, fontScale, color, thickness, cv::LINE_AA);
+}
+
+void DrawMosaic(cv::Mat &img, const cv::Rect &rect_target, const DetectionProfile &profile)
+{
+	// 截取打码区域, 限制在单元格内以免影响相邻图片
+	cv::Rect area = cv::Rect(rect_target.x + profile.mosaic.x, rect_target.y + profile.mosaic.y, profile.mosaic.width, profile.mosaic.height) &
+					cv::Rect(0, 0, img.cols, img.rows);
+	if (area.empty())
+	{
+		return;
+	}
+	cv::Mat img_mosaic = img(area).clone();
+	// 打码
+	cv::GaussianBlur(img_mosaic, img_mosaic, cv::Size(25, 25), 0);
+	// 粘贴回画布
+	img_mosaic.copyTo(img(area));
+}
+
+void AnnotateCell(cv::Mat &cell, int index, const std::string &name, const std::string &date_time, const OverlayOptions &options,
+				  const cv::Point &origin)
+{
+	// 添加序号
+	if (options.sequence)
+	{
+		DrawSequence(cell, index, origin);
+	}
+
+	// 添加日期时间
+	if (options.datetime)
+	{
+		DrawDateTime(cell, date_time, origin);
+	}
+
+	// 添加马赛克
+	if (options.mosaic)
+	{
+		cv::Rect rect_target;
+		if (FindLineEdit(cell, rect_target, options.profile))
+		{
+			DrawMosaic(cell, rect_target, options.profile);
+		}
+		else
+		{
+			spdlog::warn("Failed to find lineedit: {}", name);
+		}
+	}
+}
+
+cv::Mat ComposeImageGrid(const std::vector<std::string> &paths,
+						 const std::vector<cv::Size> &sizes,
+						 const GridLayout &layout,
+						 const OverlayOptions &options,
+						 int first_index,
+						 StitchProgress *progress,
+						 const std::vector<cv::Rect> &crops)
+{
+	return ComposeRows(
+		paths, sizes, layout, options, first_index, progress,
+		[&](size_t i, cv::Mat roi, bool streaming)
+		{
+			if (i < crops.size() && !crops[i].empty())
+			{
+				std::vector<uchar> buffer;
+				return ReadFileBytes(paths[i], buffer) && DecodeCropped(buffer, crops[i], roi, streaming);
+			}
+			return DecodeInto(paths[i], roi, streaming);
+		},
+		[&](size_t i)
+		{ return FileDateTime(paths[i]); },
+		crops);
+}
+
+cv::Mat ComposeImageGrid(const std::vector<EncodedImage> &images,
+						 const std::vector<cv::Size> &sizes,
+						 const GridLayout &layout,
+						 const OverlayOptions &options,
+						 int first_index,
+						 StitchProgress *progress,
+						 const std::vector<cv::Rect> &crops)
+{
+	std::vector<std::string> names;
+	for (const auto &image : images)
+	{
+		names.push_back(image.name);
+	}
+	return ComposeRows(
+		names, sizes, layout, options, first_index, progress,
+		[&](size_t i, cv::Mat roi, bool streaming)
+		{
+			if (i < crops.size() && !crops[i].empty())
+			{
+				return DecodeCropped(images[i].data, crops[i], roi, streaming);
+			}
+			return DecodeInto(images[i].data, images[i].name, roi, streaming);
+		},
+		[&](size_t i)
+		{ return images[i].date_time; },
+		crops);
+}
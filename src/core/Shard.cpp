@@ -0,0 +1,636 @@
+#include "Shard.h"
+#include "StreamIO.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	const char *MANIFEST_FILE = "manifest.yml";
+	const char *PROFILE_FILE = "profile.yml";
+	constexpr char BAND_MAGIC[8] = {'I', 'S', 'B', 'A', 'N', 'D', '2', '\0'};
+	constexpr uint32_t BAND_DEFLATED = 1;
+	// 分片进程与合并使用的PNG压缩级别(最快), 与WriteImage的默认值一致
+	constexpr int BAND_COMPRESSION = 1;
+
+	// 分片文件头, 之后为数据: 未压缩时为连续的BGR行, 可直接映射为cv::Mat; 压缩时为DeflateRows的输出
+	// 使用本机字节序, 分片只在同一台机器上生成和合并
+	struct BandHeader
+	{
+		char magic[8];
+		uint32_t shard;
+		uint32_t width;
+		uint32_t height;
+		// 在画布上的起始行
+		uint32_t y;
+		uint32_t flags;
+		uint32_t adler;
+		uint64_t raw_bytes;
+		uint64_t payload_bytes;
+		// 与清单的run_id一致
+		uint64_t run_id;
+	};
+	static_assert(sizeof(BandHeader) == 56, "BandHeader must not contain padding");
+
+	// FNV-1a
+	void HashBytes(uint64_t &hash, const void *data, size_t size)
+	{
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ p[i]) * 0x100000001B3ull;
+		}
+	}
+
+	template <typename T>
+	void HashValue(uint64_t &hash, const T &value)
+	{
+		HashBytes(hash, &value, sizeof(value));
+	}
+
+	// 只读映射文件, 没有mmap的平台读入内存
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		~MappedFile()
+		{
+#ifdef __linux__
+			if (m_data && m_size > 0)
+			{
+				munmap(const_cast<uchar *>(m_data), m_size);
+			}
+#endif
+		}
+
+		bool Open(const std::string &path)
+		{
+#ifdef __linux__
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				return false;
+			}
+			struct stat st{};
+			bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+			if (ok)
+			{
+				void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				ok = data != MAP_FAILED;
+				if (ok)
+				{
+					// 合并时按顺序读取一遍
+					madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+					m_data = static_cast<const uchar *>(data);
+					m_size = static_cast<size_t>(st.st_size);
+				}
+			}
+			close(fd);
+			return ok;
+#else
+			std::ifstream file(fs::u8path(path), std::ios::binary);
+			if (!file)
+			{
+				return false;
+			}
+			m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			m_data = m_buffer.data();
+			m_size = m_buffer.size();
+			return !m_buffer.empty();
+#endif
+		}
+
+		const uchar *Data() const { return m_data; }
+		size_t Size() const { return m_size; }
+
+	private:
+		const uchar *m_data = nullptr;
+		size_t m_size = 0;
+#ifndef __linux__
+		std::vector<uchar> m_buffer;
+#endif
+	};
+
+	// 检查分片文件与清单一致, 失败时记录原因
+	bool CheckBand(const MappedFile &file, const ShardManifest &manifest, int shard)
+	{
+		if (file.Size() < sizeof(BandHeader))
+		{
+			spdlog::error("Shard {}: truncated band file", shard);
+			return false;
+		}
+		BandHeader header;
+		std::memcpy(&header, file.Data(), sizeof(header));
+		cv::Range rows = manifest.CanvasRows(shard);
+		uint64_t row_bytes = static_cast<uint64_t>(manifest.layout.CanvasSize().width) * 3;
+		if (std::memcmp(header.magic, BAND_MAGIC, sizeof(BAND_MAGIC)) != 0 || header.shard != static_cast<uint32_t>(shard) ||
+			header.width != static_cast<uint32_t>(manifest.layout.CanvasSize().width) ||
+			header.y != static_cast<uint32_t>(rows.start) || header.height != static_cast<uint32_t>(rows.size()) ||
+			(header.flags & BAND_DEFLATED) != (manifest.deflate ? BAND_DEFLATED : 0))
+		{
+			spdlog::error("Shard {}: band file does not match the manifest", shard);
+			return false;
+		}
+		if (header.run_id != manifest.run_id)
+		{
+			spdlog::error("Shard {}: band file was written by another run", shard);
+			return false;
+		}
+		if (header.payload_bytes != file.Size() - sizeof(BandHeader) ||
+			(!manifest.deflate && header.payload_bytes != row_bytes * header.height))
+		{
+			spdlog::error("Shard {}: band file is incomplete", shard);
+			return false;
+		}
+		return true;
+	}
+
+	// 写到文件或stdout("-")
+	bool WriteOutput(const std::string &path, const std::function<bool(std::FILE *)> &write)
+	{
+		if (path == "-")
+		{
+			SetBinaryMode(stdout);
+			return write(stdout);
+		}
+		return WriteToFile(path, write);
+	}
+
+	// 命令行参数加引号, 交给std::system执行
+	std::string Quote(const std::string &arg)
+	{
+#ifdef _WIN32
+		return "\"" + arg + "\"";
+#else
+		std::string quoted = "'";
+		for (char c : arg)
+		{
+			quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+		}
+		return quoted + "'";
+#endif
+	}
+
+	// 运行命令并返回退出码, 无法运行或被信号终止时返回-1
+	int RunProcess(const std::string &command)
+	{
+#ifdef _WIN32
+		// cmd /c会去掉最外层的引号
+		return std::system(("\"" + command + "\"").c_str());
+#else
+		int status = std::system(command.c_str());
+		return status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+	}
+}
+
+cv::Range ShardManifest::Rows(int shard) const
+{
+	long long rows = layout.rows;
+	return cv::Range(static_cast<int>(rows * shard / shards), static_cast<int>(rows * (shard + 1) / shards));
+}
+
+cv::Range ShardManifest::CanvasRows(int shard) const
+{
+	cv::Range rows = Rows(shard);
+	int y = rows.start * (layout.cell_height + layout.margin);
+	int height = rows.size() * layout.cell_height + std::max(rows.size() - 1, 0) * layout.margin;
+	return cv::Range(y, y + height);
+}
+
+void ShardManifest::AssignRunId()
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (const auto &path : paths)
+	{
+		HashBytes(hash, path.data(), path.size() + 1);
+	}
+	for (const auto &size : sizes)
+	{
+		HashValue(hash, size.width);
+		HashValue(hash, size.height);
+	}
+	for (const auto &crop : crops)
+	{
+		HashValue(hash, crop.x);
+		HashValue(hash, crop.y);
+		HashValue(hash, crop.width);
+		HashValue(hash, crop.height);
+	}
+	for (int value : {layout.rows, layout.cols, layout.margin, layout.cell_width, layout.cell_height,
+					  static_cast<int>(overlay.sequence), static_cast<int>(overlay.datetime), static_cast<int>(overlay.mosaic),
+					  shards, static_cast<int>(deflate)})
+	{
+		HashValue(hash, value);
+	}
+	// 相同的输入重新运行时也不能混用之前的分片
+	HashValue(hash, std::chrono::system_clock::now().time_since_epoch().count());
+	run_id = hash != 0 ? hash : 1;
+}
+
+bool ShardManifest::Save(const std::string &dir) const
+{
+	std::string path = (fs::u8path(dir) / MANIFEST_FILE).string();
+	try
+	{
+		cv::FileStorage storage(path, cv::FileStorage::WRITE);
+		if (!storage.isOpened())
+		{
+			spdlog::error("Failed to write shard manifest: {}", path);
+			return false;
+		}
+		std::vector<int> widths, heights, crop_values;
+		for (const auto &size : sizes)
+		{
+			widths.push_back(size.width);
+			heights.push_back(size.height);
+		}
+		for (const auto &crop : crops)
+		{
+			crop_values.insert(crop_values.end(), {crop.x, crop.y, crop.width, crop.height});
+		}
+		storage << "images" << paths;
+		storage << "widths" << widths;
+		storage << "heights" << heights;
+		storage << "crops" << crop_values;
+		storage << "rows" << layout.rows;
+		storage << "cols" << layout.cols;
+		storage << "margin" << layout.margin;
+		storage << "cell_width" << layout.cell_width;
+		storage << "cell_height" << layout.cell_height;
+		storage << "sequence" << static_cast<int>(overlay.sequence);
+		storage << "datetime" << static_cast<int>(overlay.datetime);
+		storage << "mosaic" << static_cast<int>(overlay.mosaic);
+		storage << "shards" << shards;
+		storage << "deflate" << static_cast<int>(deflate);
+		// FileStorage的整数为32位, 以十六进制字符串保存
+		char run_id_text[32];
+		std::snprintf(run_id_text, sizeof(run_id_text), "%016llx", static_cast<unsigned long long>(run_id));
+		storage << "run_id" << std::string(run_id_text);
+	}
+	catch (const cv::Exception &e)
+	{
+		spdlog::error("Failed to write shard manifest {}: {}", path, e.what());
+		return false;
+	}
+	return overlay.profile.Save((fs::u8path(dir) / PROFILE_FILE).string());
+}
+
+bool ShardManifest::Load(const std::string &dir)
+{
+	std::string path = (fs::u8path(dir) / MANIFEST_FILE).string();
+	try
+	{
+		cv::FileStorage storage(path, cv::FileStorage::READ);
+		if (!storage.isOpened())
+		{
+			spdlog::error("Failed to open shard manifest: {}", path);
+			return false;
+		}
+		std::vector<int> widths, heights, crop_values;
+		storage["images"] >> paths;
+		storage["widths"] >> widths;
+		storage["heights"] >> heights;
+		storage["crops"] >> crop_values;
+		layout.rows = static_cast<int>(storage["rows"]);
+		layout.cols = static_cast<int>(storage["cols"]);
+		layout.margin = static_cast<int>(storage["margin"]);
+		layout.cell_width = static_cast<int>(storage["cell_width"]);
+		layout.cell_height = static_cast<int>(storage["cell_height"]);
+		overlay.sequence = static_cast<int>(storage["sequence"]) != 0;
+		overlay.datetime = static_cast<int>(storage["datetime"]) != 0;
+		overlay.mosaic = static_cast<int>(storage["mosaic"]) != 0;
+		shards = static_cast<int>(storage["shards"]);
+		deflate = static_cast<int>(storage["deflate"]) != 0;
+		std::string run_id_text = static_cast<std::string>(storage["run_id"]);
+		run_id = std::strtoull(run_id_text.c_str(), nullptr, 16);
+
+		if (widths.size() != paths.size() || heights.size() != paths.size() ||
+			(!crop_values.empty() && crop_values.size() != paths.size() * 4) ||
+			layout.rows <= 0 || layout.cols <= 0 || shards <= 0 || shards > layout.rows || run_id == 0)
+		{
+			spdlog::error("Invalid shard manifest: {}", path);
+			return false;
+		}
+		sizes.clear();
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			sizes.emplace_back(widths[i], heights[i]);
+		}
+		crops.clear();
+		for (size_t i = 0; i < crop_values.size(); i += 4)
+		{
+			crops.emplace_back(crop_values[i], crop_values[i + 1], crop_values[i + 2], crop_values[i + 3]);
+		}
+	}
+	catch (const cv::Exception &e)
+	{
+		spdlog::error("Failed to parse shard manifest {}: {}", path, e.what());
+		return false;
+	}
+	return overlay.profile.Load((fs::u8path(dir) / PROFILE_FILE).string());
+}
+
+std::string BandPath(const std::string &dir, int shard)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "band_%03d.band", shard);
+	return (fs::u8path(dir) / name).string();
+}
+
+bool RenderShard(const ShardManifest &manifest, const std::string &dir, int shard)
+{
+	if (shard < 0 || shard >= manifest.shards)
+	{
+		spdlog::error("Shard index {} out of range, the manifest has {} shards", shard, manifest.shards);
+		return false;
+	}
+	// 各分片进程同时运行, 平分CPU
+	cv::setNumThreads(std::max(1, cv::getNumberOfCPUs() / manifest.shards));
+
+	// 1. 合成本分片的网格行, 序号与整张画布一致
+	cv::Range rows = manifest.Rows(shard);
+	size_t cols = static_cast<size_t>(manifest.layout.cols);
+	size_t begin = std::min(rows.start * cols, manifest.paths.size());
+	size_t end = std::min(rows.end * cols, manifest.paths.size());
+	GridLayout layout = manifest.layout;
+	layout.rows = rows.size();
+	spdlog::info("Rendering shard {} of {}: grid rows {}-{}, {} images", shard, manifest.shards, rows.start, rows.end - 1, end - begin);
+
+	std::vector<std::string> paths(manifest.paths.begin() + begin, manifest.paths.begin() + end);
+	std::vector<cv::Size> sizes(manifest.sizes.begin() + begin, manifest.sizes.begin() + end);
+	std::vector<cv::Rect> crops;
+	if (!manifest.crops.empty())
+	{
+		crops.assign(manifest.crops.begin() + begin, manifest.crops.begin() + end);
+	}
+	cv::Mat band = ComposeImageGrid(paths, sizes, layout, manifest.overlay, static_cast<int>(begin), nullptr, crops);
+
+	// 2. 按需压缩
+	BandHeader header{};
+	std::memcpy(header.magic, BAND_MAGIC, sizeof(BAND_MAGIC));
+	header.run_id = manifest.run_id;
+	header.shard = static_cast<uint32_t>(shard);
+	header.width = static_cast<uint32_t>(band.cols);
+	header.height = static_cast<uint32_t>(band.rows);
+	header.y = static_cast<uint32_t>(manifest.CanvasRows(shard).start);
+	size_t row_bytes = static_cast<size_t>(band.cols) * 3;
+	std::vector<uchar> deflated;
+	DeflatedSegment segment;
+	if (manifest.deflate)
+	{
+		if (!DeflateRows(band, BAND_COMPRESSION, deflated, segment))
+		{
+			spdlog::error("Shard {}: failed to compress rows", shard);
+			return false;
+		}
+		header.flags = BAND_DEFLATED;
+		header.adler = segment.adler;
+		header.raw_bytes = segment.raw_bytes;
+		header.payload_bytes = segment.size;
+		// 已压缩, 提前释放画布
+		band.release();
+	}
+	else
+	{
+		header.raw_bytes = static_cast<uint64_t>(row_bytes) * band.rows;
+		header.payload_bytes = header.raw_bytes;
+	}
+
+	// 3. 写入临时文件后重命名
+	std::string path = BandPath(dir, shard);
+	std::string temp_path = path + ".tmp";
+	bool ok = WriteOutput(temp_path, [&](std::FILE *out)
+						  {
+		if (std::fwrite(&header, 1, sizeof(header), out) != sizeof(header))
+		{
+			return false;
+		}
+		if (manifest.deflate)
+		{
+			return std::fwrite(segment.data, 1, segment.size, out) == segment.size;
+		}
+		for (int y = 0; y < band.rows; ++y)
+		{
+			if (std::fwrite(band.ptr<uchar>(y), 1, row_bytes, out) != row_bytes)
+			{
+				return false;
+			}
+		}
+		return true; });
+	std::error_code ec;
+	if (ok)
+	{
+		fs::rename(fs::u8path(temp_path), fs::u8path(path), ec);
+		ok = !ec;
+	}
+	if (!ok)
+	{
+		spdlog::error("Failed to write band file: {}", path);
+		fs::remove(fs::u8path(temp_path), ec);
+		return false;
+	}
+	spdlog::info("Shard {} of {} written to {} ({} bytes)", shard, manifest.shards, path, header.payload_bytes);
+	return true;
+}
+
+bool RunShards(const std::string &executable, const ShardManifest &manifest, const std::string &dir, int retries)
+{
+	std::vector<int> pending(manifest.shards);
+	for (int i = 0; i < manifest.shards; ++i)
+	{
+		pending[i] = i;
+	}
+
+	for (int attempt = 0; attempt <= retries && !pending.empty(); ++attempt)
+	{
+		if (attempt > 0)
+		{
+			spdlog::warn("Retrying {} failed shards (attempt {} of {})", pending.size(), attempt, retries);
+		}
+
+		// 每个分片一个进程, 由各自的线程等待退出
+		std::vector<int> codes(pending.size(), -1);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < pending.size(); ++i)
+		{
+			std::string command = Quote(executable) + " --shard " + std::to_string(pending[i]) + " --band-dir " + Quote(dir);
+			threads.emplace_back([&codes, i, command]()
+								 { codes[i] = RunProcess(command); });
+		}
+		for (auto &thread : threads)
+		{
+			thread.join();
+		}
+
+		std::vector<int> failed;
+		for (size_t i = 0; i < pending.size(); ++i)
+		{
+			if (codes[i] != 0)
+			{
+				spdlog::error("Shard {} failed with exit code {}", pending[i], codes[i]);
+				failed.push_back(pending[i]);
+			}
+		}
+		pending.swap(failed);
+	}
+
+	if (!pending.empty())
+	{
+		std::string list;
+		for (int shard : pending)
+		{
+			list += (list.empty() ? "" : ", ") + std::to_string(shard);
+		}
+		spdlog::error("Shards {} failed, rerun each with --shard <index> --band-dir {} and then --merge", list, dir);
+		return false;
+	}
+	return true;
+}
+
+bool MergeShards(const ShardManifest &manifest, const std::string &dir, const std::string &output, bool tiles)
+{
+	std::string ext = fs::u8path(output).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (output != "-" && ext != ".png")
+	{
+		spdlog::error("Merged shards are written as PNG, expected a .png output: {}", output);
+		return false;
+	}
+	if (tiles && output == "-")
+	{
+		spdlog::error("Cannot write tiles to stdout, specify an output file");
+		return false;
+	}
+
+	// 1. 映射并检查全部分片, 缺失或损坏的分片需要单独重新运行
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::string missing;
+	for (int shard = 0; shard < manifest.shards; ++shard)
+	{
+		auto file = std::make_unique<MappedFile>();
+		if (!file->Open(BandPath(dir, shard)) || !CheckBand(*file, manifest, shard))
+		{
+			missing += (missing.empty() ? "" : ", ") + std::to_string(shard);
+		}
+		files.push_back(std::move(file));
+	}
+	if (!missing.empty())
+	{
+		spdlog::error("Shards {} are missing or invalid, rerun each with --shard <index> --band-dir {}", missing, dir);
+		return false;
+	}
+
+	cv::Size canvas_size = manifest.layout.CanvasSize();
+	spdlog::info("Merging {} shards into {}x{}", manifest.shards, canvas_size.width, canvas_size.height);
+
+	// 2. 分片之间补上间距
+	cv::Mat margin(manifest.layout.margin, canvas_size.width, CV_8UC3, cv::Scalar(255, 255, 255));
+	bool ok = true;
+	if (manifest.deflate)
+	{
+		std::vector<uchar> margin_data;
+		DeflatedSegment margin_segment;
+		if (!margin.empty() && !DeflateRows(margin, BAND_COMPRESSION, margin_data, margin_segment))
+		{
+			return false;
+		}
+		std::vector<DeflatedSegment> segments;
+		for (int shard = 0; shard < manifest.shards; ++shard)
+		{
+			BandHeader header;
+			std::memcpy(&header, files[shard]->Data(), sizeof(header));
+			DeflatedSegment segment;
+			segment.data = files[shard]->Data() + sizeof(BandHeader);
+			segment.size = static_cast<size_t>(header.payload_bytes);
+			segment.raw_bytes = header.raw_bytes;
+			segment.adler = header.adler;
+			if (tiles)
+			{
+				ok = ok && WriteOutput(PageOutputPath(output, shard), [&](std::FILE *out)
+									   { return WritePngSegments({segment}, canvas_size.width, static_cast<int>(header.height), out); });
+				continue;
+			}
+			if (shard > 0 && !margin.empty())
+			{
+				segments.push_back(margin_segment);
+			}
+			segments.push_back(segment);
+		}
+		if (!tiles)
+		{
+			ok = WriteOutput(output, [&](std::FILE *out)
+							 { return WritePngSegments(segments, canvas_size.width, canvas_size.height, out); });
+		}
+	}
+	else
+	{
+		// 未压缩的分片直接作为画布的行, 不复制
+		std::vector<cv::Mat> parts;
+		for (int shard = 0; shard < manifest.shards; ++shard)
+		{
+			cv::Mat rows(manifest.CanvasRows(shard).size(), canvas_size.width, CV_8UC3,
+						 const_cast<uchar *>(files[shard]->Data() + sizeof(BandHeader)));
+			if (tiles)
+			{
+				ok = ok && WriteOutput(PageOutputPath(output, shard), [&](std::FILE *out)
+									   { return WritePngRows({rows}, out, BAND_COMPRESSION); });
+				continue;
+			}
+			if (shard > 0 && !margin.empty())
+			{
+				parts.push_back(margin);
+			}
+			parts.push_back(rows);
+		}
+		if (!tiles)
+		{
+			ok = WriteOutput(output, [&](std::FILE *out)
+							 { return WritePngRows(parts, out, BAND_COMPRESSION); });
+		}
+	}
+
+	if (!ok)
+	{
+		spdlog::error("Failed to merge shards into {}", output);
+		return false;
+	}
+	spdlog::info("Successfully merged {} shards into {}", manifest.shards, tiles ? PageOutputPath(output, 0) + "..." : output);
+	return true;
+}
+
+void RemoveShardFiles(const ShardManifest &manifest, const std::string &dir)
+{
+	std::error_code ec;
+	for (int shard = 0; shard < manifest.shards; ++shard)
+	{
+		fs::remove(fs::u8path(BandPath(dir, shard)), ec);
+	}
+	fs::remove(fs::u8path(dir) / MANIFEST_FILE, ec);
+	fs::remove(fs::u8path(dir) / PROFILE_FILE, ec);
+	// 目录非空时保留
+	fs::remove(fs::u8path(dir), ec);
+}
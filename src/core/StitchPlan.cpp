@@ -0,0 +1,282 @@
+#include "StitchPlan.h"
+#include <spdlog/spdlog.h>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	bool IsPngPath(const std::string &path)
+	{
+		std::string ext = fs::path(path).extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		return ext == ".png";
+	}
+
+	std::string JsonString(const std::string &text)
+	{
+		std::ostringstream out;
+		out << '"';
+		for (unsigned char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				out << '\\' << c;
+			}
+			else if (c < 0x20)
+			{
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+			}
+			else
+			{
+				out << c;
+			}
+		}
+		out << '"';
+		return out.str();
+	}
+
+	// 取多次运行中最快的一次, 单位毫秒
+	double MeasureMs(const std::function<void()> &fn)
+	{
+		double best = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			auto start = cv::getTickCount();
+			fn();
+			double ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+			best = i == 0 ? ms : std::min(best, ms);
+		}
+		return best;
+	}
+}
+
+CostModel CostModel::Calibrate()
+{
+	// 合成截图样式的图片: 大面积纯色背景、文字行和一块照片区域
+	cv::Mat img(1920, 1080, CV_8UC3, cv::Scalar(245, 245, 245));
+	for (int y = 0; y + 140 < img.rows; y += 160)
+	{
+		cv::rectangle(img, cv::Rect(40, y + 20, img.cols - 80, 120), cv::Scalar(255, 255, 255), cv::FILLED);
+		cv::putText(img, "13800138000  2024-01-01 12:00:00", cv::Point(60, y + 100), cv::FONT_HERSHEY_SIMPLEX, 1.2, cv::Scalar(40, 40, 40), 2, cv::LINE_AA);
+	}
+	cv::Mat photo(img.rows / 4, img.cols, CV_8UC3);
+	cv::randu(photo, cv::Scalar::all(0), cv::Scalar::all(255));
+	cv::GaussianBlur(photo, photo, cv::Size(9, 9), 0);
+	photo.copyTo(img.rowRange(0, photo.rows));
+
+	CostModel model;
+	double mp = img.total() / 1e6;
+	std::vector<uchar> png, jpeg;
+	model.encode_png_ms_per_mp = MeasureMs([&]()
+										   { cv::imencode(".png", img, png); }) / mp;
+	model.decode_png_ms_per_mp = MeasureMs([&]()
+										   { cv::imdecode(png, cv::IMREAD_COLOR); }) / mp;
+	model.encode_jpeg_ms_per_mp = MeasureMs([&]()
+											{ cv::imencode(".jpg", img, jpeg); }) / mp;
+	model.decode_jpeg_ms_per_mp = MeasureMs([&]()
+											{ cv::imdecode(jpeg, cv::IMREAD_COLOR); }) / mp;
+	model.detect_ms_per_mp = MeasureMs([&]()
+									   { cv::Rect rect_target; FindLineEdit(img, rect_target); }) / mp;
+	model.png_bytes_per_pixel = static_cast<double>(png.size()) / img.total();
+	model.jpeg_bytes_per_pixel = static_cast<double>(jpeg.size()) / img.total();
+	model.calibrated = true;
+	return model;
+}
+
+std::string StitchPlan::ToJson() const
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	out << "{\n";
+	out << "  \"images\": " << images << ",\n";
+	out << "  \"unreadable\": " << unreadable << ",\n";
+	out << "  \"input_megapixels\": " << input_megapixels << ",\n";
+	out << "  \"pages\": [";
+	for (size_t i = 0; i < pages.size(); ++i)
+	{
+		const Page &page = pages[i];
+		cv::Size canvas = page.layout.CanvasSize();
+		out << (i == 0 ? "\n" : ",\n");
+		out << "    {\"output\": " << JsonString(page.output)
+			<< ", \"first\": " << page.range.begin + 1
+			<< ", \"images\": " << page.range.Count()
+			<< ", \"rows\": " << page.layout.rows
+			<< ", \"cols\": " << page.layout.cols
+			<< ", \"cell_width\": " << page.layout.cell_width
+			<< ", \"cell_height\": " << page.layout.cell_height
+			<< ", \"width\": " << canvas.width
+			<< ", \"height\": " << canvas.height << "}";
+	}
+	out << (pages.empty() ? "],\n" : "\n  ],\n");
+	out << "  \"page_jobs\": " << page_jobs << ",\n";
+	out << "  \"threads\": " << threads << ",\n";
+	out << "  \"canvas_megapixels\": " << canvas_megapixels << ",\n";
+	out << "  \"buffer_bytes\": " << buffer_bytes << ",\n";
+	out << "  \"input_bytes\": " << input_bytes << ",\n";
+	out << "  \"working_bytes\": " << working_bytes << ",\n";
+	out << "  \"peak_memory_bytes\": " << peak_memory_bytes << ",\n";
+	out << "  \"output_bytes\": " << output_bytes << ",\n";
+	out << "  \"autocrop_excluded\": " << (autocrop_excluded ? "true" : "false") << ",\n";
+	out << "  \"estimate_ms\": {\"decode\": " << decode_ms
+		<< ", \"annotate\": " << annotate_ms
+		<< ", \"encode\": " << encode_ms
+		<< ", \"total\": " << TotalMs() << "},\n";
+	out << "  \"rates\": {\"calibrated\": " << (model.calibrated ? "true" : "false")
+		<< ", \"decode_png_ms_per_mp\": " << model.decode_png_ms_per_mp
+		<< ", \"decode_jpeg_ms_per_mp\": " << model.decode_jpeg_ms_per_mp
+		<< ", \"encode_png_ms_per_mp\": " << model.encode_png_ms_per_mp
+		<< ", \"encode_jpeg_ms_per_mp\": " << model.encode_jpeg_ms_per_mp
+		<< ", \"detect_ms_per_mp\": " << model.detect_ms_per_mp
+		<< ", \"png_bytes_per_pixel\": " << model.png_bytes_per_pixel
+		<< ", \"jpeg_bytes_per_pixel\": " << model.jpeg_bytes_per_pixel << "}\n";
+	out << "}";
+	return out.str();
+}
+
+StitchPlan PlanStitch(const std::vector<std::string> &paths,
+					  const std::vector<cv::Size> &sizes,
+					  const StitchOptions &options,
+					  const CostModel &model,
+					  size_t unreadable,
+					  const std::vector<size_t> &frame_bytes)
+{
+	StitchPlan plan;
+	plan.images = paths.size();
+	plan.unreadable = unreadable;
+	plan.model = model;
+	plan.threads = std::max(1, cv::getNumThreads());
+	if (paths.empty())
+	{
+		return plan;
+	}
+
+	// 解码与检测按线程数并行
+	size_t max_file_bytes = 0, max_image_pixels = 0;
+	double decode_ms = 0, detect_ms = 0;
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		max_image_pixels = std::max(max_image_pixels, static_cast<size_t>(sizes[i].width) * sizes[i].height);
+		double mp = static_cast<double>(sizes[i].width) * sizes[i].height / 1e6;
+		plan.input_megapixels += mp;
+		decode_ms += mp * (IsPngPath(paths[i]) ? model.decode_png_ms_per_mp : model.decode_jpeg_ms_per_mp);
+		if (options.overlay.mosaic)
+		{
+			detect_ms += mp * model.detect_ms_per_mp;
+		}
+		// 内存中的图片直接解码, 不需要读取缓冲, 但全部保留到运行结束
+		if (!frame_bytes.empty())
+		{
+			plan.input_bytes += frame_bytes[i];
+			continue;
+		}
+		std::error_code ec;
+		size_t file_bytes = static_cast<size_t>(fs::file_size(paths[i], ec));
+		if (!ec)
+		{
+			max_file_bytes = std::max(max_file_bytes, file_bytes);
+		}
+	}
+	plan.decode_ms = decode_ms / plan.threads;
+	plan.annotate_ms = detect_ms / plan.threads;
+
+	// 各页布局, 与ProcessImages使用相同的分页规则
+	std::vector<PageRange> ranges = SplitPages(sizes, options.rows, options.cols, options.margin,
+											   options.max_per_page, options.max_page_pixels);
+	plan.page_jobs = options.PageJobs(ranges.size());
+	bool png_output = options.OutputExtension() == ".png";
+	double encode_rate = png_output ? model.encode_png_ms_per_mp : model.encode_jpeg_ms_per_mp;
+	double bytes_per_pixel = png_output ? model.png_bytes_per_pixel : model.jpeg_bytes_per_pixel;
+	std::vector<size_t> canvas_bytes;
+	double encode_total = 0, encode_max = 0;
+	for (size_t k = 0; k < ranges.size(); ++k)
+	{
+		StitchPlan::Page page;
+		page.range = ranges[k];
+		std::vector<cv::Size> page_sizes(sizes.begin() + page.range.begin, sizes.begin() + page.range.end);
+		page.layout = ComputeGridLayout(page_sizes, options.rows, options.cols, options.margin);
+		// stdout不能分页, 多页时ProcessImages会拒绝执行, 这里不生成"-"的分页文件名
+		page.output = ranges.size() == 1 || options.output == "-" ? options.output : PageOutputPath(options.output, k);
+
+		cv::Size canvas = page.layout.CanvasSize();
+		double pixels = static_cast<double>(canvas.width) * canvas.height;
+		plan.canvas_megapixels += pixels / 1e6;
+		canvas_bytes.push_back(static_cast<size_t>(pixels) * 3);
+		double encode = pixels / 1e6 * encode_rate;
+		encode_total += encode;
+		encode_max = std::max(encode_max, encode);
+		plan.output_bytes += static_cast<size_t>(pixels * bytes_per_pixel);
+		plan.pages.push_back(page);
+	}
+	plan.encode_ms = std::max(encode_max, encode_total / plan.page_jobs);
+
+	// 峰值内存: 最大的page_jobs张画布同时存在, 加上各解码线程的文件缓冲、解码/检测内存和内存中的图片
+	// 解码结果3字节/像素; 检测的灰度、颜色掩码、边缘图和轮廓约6字节/像素
+	std::sort(canvas_bytes.begin(), canvas_bytes.end(), std::greater<size_t>());
+	plan.buffer_bytes = static_cast<size_t>(plan.threads) * max_file_bytes;
+	plan.working_bytes = static_cast<size_t>(plan.threads) * max_image_pixels * (options.overlay.mosaic ? 3 + 6 : 3);
+	plan.peak_memory_bytes = plan.buffer_bytes + plan.working_bytes + plan.input_bytes;
+	for (size_t k = 0; k < plan.page_jobs && k < canvas_bytes.size(); ++k)
+	{
+		plan.peak_memory_bytes += canvas_bytes[k];
+	}
+	return plan;
+}
+
+bool FitToMemory(const std::vector<std::string> &paths,
+				 const std::vector<cv::Size> &sizes,
+				 StitchOptions &options,
+				 const CostModel &model,
+				 size_t max_memory_bytes,
+				 const std::vector<size_t> &frame_bytes)
+{
+	StitchPlan plan = PlanStitch(paths, sizes, options, model, 0, frame_bytes);
+	if (plan.peak_memory_bytes <= max_memory_bytes)
+	{
+		return true;
+	}
+	spdlog::warn("Predicted peak memory {} MB exceeds the limit of {} MB",
+				 plan.peak_memory_bytes >> 20, max_memory_bytes >> 20);
+
+	// 1. 逐页处理
+	if (plan.page_jobs > 1)
+	{
+		options.page_jobs = 1;
+		plan = PlanStitch(paths, sizes, options, model, 0, frame_bytes);
+		if (plan.peak_memory_bytes <= max_memory_bytes)
+		{
+			spdlog::warn("Processing one page at a time");
+			return true;
+		}
+	}
+
+	// 2. 按剩余内存可容纳的画布像素分页, stdout只能输出一页
+	if (options.output == "-")
+	{
+		spdlog::error("Refusing to stitch: predicted peak memory {} MB exceeds the limit of {} MB and stdout output cannot be split into pages",
+					  plan.peak_memory_bytes >> 20, max_memory_bytes >> 20);
+		return false;
+	}
+	size_t fixed_bytes = plan.buffer_bytes + plan.working_bytes + plan.input_bytes;
+	if (max_memory_bytes > fixed_bytes)
+	{
+		long long pixels = static_cast<long long>((max_memory_bytes - fixed_bytes) / 3);
+		options.max_page_pixels = options.max_page_pixels > 0 ? std::min(options.max_page_pixels, pixels) : pixels;
+		plan = PlanStitch(paths, sizes, options, model, 0, frame_bytes);
+		if (plan.peak_memory_bytes <= max_memory_bytes)
+		{
+			spdlog::warn("Splitting into {} pages of at most {} pixels", plan.pages.size(), options.max_page_pixels);
+			return true;
+		}
+	}
+
+	spdlog::error("Refusing to stitch: predicted peak memory {} MB exceeds the limit of {} MB even with one image per page",
+				  plan.peak_memory_bytes >> 20, max_memory_bytes >> 20);
+	return false;
+}
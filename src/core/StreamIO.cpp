@@ -0,0 +1,415 @@
+#include "StreamIO.h"
+#include <spdlog/spdlog.h>
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <zlib.h>
+
+// zlib只在启用大文件支持时声明64位长度的版本, 但库中总是导出; 默认配置下补充声明
+// (Windows的z_off_t为32位, 超过2 GiB的数据段需要64位长度)
+#if !defined(Z_LARGE64) && !defined(Z_WANT64)
+extern "C" uLong ZEXPORT adler32_combine64(uLong, uLong, z_off64_t);
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// 单帧大小上限, 防止错误的长度前缀导致分配过大的内存
+	constexpr uint32_t MAX_FRAME_BYTES = 1u << 30;
+	// 每个IDAT块的大小, 也是每次写出的数据量
+	constexpr size_t PNG_CHUNK_BYTES = 256 * 1024;
+
+	void WriteUInt32(unsigned char *p, uint32_t value)
+	{
+		p[0] = static_cast<unsigned char>(value >> 24);
+		p[1] = static_cast<unsigned char>(value >> 16);
+		p[2] = static_cast<unsigned char>(value >> 8);
+		p[3] = static_cast<unsigned char>(value);
+	}
+
+	// 按文件签名生成名称, 扩展名用于预估编解码耗时
+	std::string FrameName(const std::vector<uchar> &data, size_t index)
+	{
+		const char *ext = data.size() >= 2 && data[0] == 0xFF && data[1] == 0xD8 ? ".jpg" : ".png";
+		char name[32];
+		std::snprintf(name, sizeof(name), "stdin_%03zu%s", index + 1, ext);
+		return name;
+	}
+
+	bool WriteChunk(std::FILE *out, const char *type, const unsigned char *data, size_t size)
+	{
+		unsigned char header[8];
+		WriteUInt32(header, static_cast<uint32_t>(size));
+		std::memcpy(header + 4, type, 4);
+		uLong crc = crc32(0L, header + 4, 4);
+		if (size > 0)
+		{
+			crc = crc32(crc, data, static_cast<uInt>(size));
+		}
+		unsigned char footer[4];
+		WriteUInt32(footer, static_cast<uint32_t>(crc));
+		return std::fwrite(header, 1, sizeof(header), out) == sizeof(header) &&
+			   std::fwrite(data, 1, size, out) == size &&
+			   std::fwrite(footer, 1, sizeof(footer), out) == sizeof(footer);
+	}
+
+	// 转换为RGB并生成一行PNG数据(首字节为滤波类型), 之后previous为本行
+	// up为false时不滤波, 用于不能引用上一行的分片首行
+	void FilterRow(const unsigned char *bgr, std::vector<unsigned char> &rgb, std::vector<unsigned char> &previous,
+				   std::vector<unsigned char> &filtered, bool up)
+	{
+		size_t row_bytes = rgb.size();
+		for (size_t x = 0; x < row_bytes; x += 3)
+		{
+			rgb[x] = bgr[x + 2];
+			rgb[x + 1] = bgr[x + 1];
+			rgb[x + 2] = bgr[x];
+		}
+		filtered[0] = up ? 2 : 0;
+		for (size_t x = 0; x < row_bytes; ++x)
+		{
+			filtered[x + 1] = up ? static_cast<unsigned char>(rgb[x] - previous[x]) : rgb[x];
+		}
+		rgb.swap(previous);
+	}
+
+	bool WritePngHeader(std::FILE *out, int width, int height)
+	{
+		static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+		unsigned char ihdr[13] = {};
+		WriteUInt32(ihdr, static_cast<uint32_t>(width));
+		WriteUInt32(ihdr + 4, static_cast<uint32_t>(height));
+		ihdr[8] = 8; // 位深
+		ihdr[9] = 2; // RGB
+		return std::fwrite(signature, 1, sizeof(signature), out) == sizeof(signature) &&
+			   WriteChunk(out, "IHDR", ihdr, sizeof(ihdr));
+	}
+
+	// 流式PNG编码: 逐行转换为RGB并使用Up滤波(截图中大面积重复的行压缩效果好), 每满一块即写出
+	// parts为依次相接、宽度相同的行
+	bool WritePng(const std::vector<cv::Mat> &parts, std::FILE *out, StitchProgress *progress, int compression)
+	{
+		int width = parts.empty() ? 0 : parts.front().cols;
+		int height = 0;
+		for (const auto &part : parts)
+		{
+			if (part.cols != width || part.type() != CV_8UC3)
+			{
+				return false;
+			}
+			height += part.rows;
+		}
+		if (!WritePngHeader(out, width, height))
+		{
+			return false;
+		}
+
+		z_stream stream{};
+		if (deflateInit(&stream, compression) != Z_OK)
+		{
+			return false;
+		}
+		size_t row_bytes = static_cast<size_t>(width) * 3;
+		std::vector<unsigned char> rgb(row_bytes), previous(row_bytes, 0), filtered(row_bytes + 1);
+		std::vector<unsigned char> chunk(PNG_CHUNK_BYTES);
+		stream.next_out = chunk.data();
+		stream.avail_out = static_cast<uInt>(chunk.size());
+
+		bool ok = true;
+		auto deflate_rows = [&](int flush)
+		{
+			int status = Z_OK;
+			do
+			{
+				status = deflate(&stream, flush);
+				if (status == Z_STREAM_ERROR)
+				{
+					return false;
+				}
+				if (stream.avail_out == 0 || (flush == Z_FINISH && status == Z_STREAM_END))
+				{
+					size_t size = chunk.size() - stream.avail_out;
+					if (size > 0 && (!WriteChunk(out, "IDAT", chunk.data(), size) || std::fflush(out) != 0))
+					{
+						return false;
+					}
+					stream.next_out = chunk.data();
+					stream.avail_out = static_cast<uInt>(chunk.size());
+				}
+			} while (stream.avail_in > 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+			return true;
+		};
+
+		if (progress)
+		{
+			progress->SetTotal(StitchProgress::ENCODE, height);
+		}
+		for (size_t i = 0; i < parts.size() && ok; ++i)
+		{
+			for (int y = 0; y < parts[i].rows && ok; ++y)
+			{
+				if (progress && progress->Cancelled())
+				{
+					ok = false;
+					break;
+				}
+				FilterRow(parts[i].ptr<unsigned char>(y), rgb, previous, filtered, true);
+
+				stream.next_in = filtered.data();
+				stream.avail_in = static_cast<uInt>(filtered.size());
+				ok = deflate_rows(Z_NO_FLUSH);
+				if (progress)
+				{
+					progress->Advance(StitchProgress::ENCODE);
+				}
+			}
+		}
+		ok = ok && deflate_rows(Z_FINISH);
+		deflateEnd(&stream);
+
+		return ok && WriteChunk(out, "IEND", nullptr, 0) && std::fflush(out) == 0;
+	}
+}
+
+void SetBinaryMode(std::FILE *file)
+{
+#ifdef _WIN32
+	_setmode(_fileno(file), _O_BINARY);
+#else
+	(void)file;
+#endif
+}
+
+bool ReadImageFrames(std::FILE *in, std::vector<EncodedImage> &images)
+{
+	unsigned char length_bytes[4];
+	while (size_t read = std::fread(length_bytes, 1, sizeof(length_bytes), in))
+	{
+		if (read != sizeof(length_bytes))
+		{
+			spdlog::error("Truncated frame header after {} images", images.size());
+			return false;
+		}
+		uint32_t length = (uint32_t(length_bytes[0]) << 24) | (uint32_t(length_bytes[1]) << 16) |
+						  (uint32_t(length_bytes[2]) << 8) | uint32_t(length_bytes[3]);
+		if (length == 0 || length > MAX_FRAME_BYTES)
+		{
+			spdlog::error("Invalid frame length {} after {} images", length, images.size());
+			return false;
+		}
+
+		// 直接读入帧缓冲, 解码时原地使用
+		EncodedImage image;
+		image.data.resize(length);
+		if (std::fread(image.data.data(), 1, length, in) != length)
+		{
+			spdlog::error("Truncated frame after {} images", images.size());
+			return false;
+		}
+		image.name = FrameName(image.data, images.size());
+		image.date_time = FormatDateTime(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+		images.push_back(std::move(image));
+	}
+	return !std::ferror(in);
+}
+
+std::vector<std::string> ReadPathList(std::FILE *in)
+{
+	std::vector<std::string> paths;
+	std::string path;
+	for (int c = std::fgetc(in);; c = std::fgetc(in))
+	{
+		if (c == EOF || c == '\0')
+		{
+			if (!path.empty())
+			{
+				paths.push_back(path);
+				path.clear();
+			}
+			if (c == EOF)
+			{
+				break;
+			}
+			continue;
+		}
+		path.push_back(static_cast<char>(c));
+	}
+	return paths;
+}
+
+bool WriteImage(const cv::Mat &img, const std::string &ext, std::FILE *out, StitchProgress *progress, int png_compression)
+{
+	if (ext == ".png" && img.type() == CV_8UC3)
+	{
+		return WritePng({img}, out, progress, png_compression);
+	}
+
+	// 其他格式先编码到内存再分块写出, 编码完成后一次更新进度
+	std::vector<uchar> buffer;
+	if (!cv::imencode(ext, img, buffer))
+	{
+		return false;
+	}
+	if (progress)
+	{
+		progress->SetTotal(StitchProgress::ENCODE, img.rows);
+		progress->Advance(StitchProgress::ENCODE, img.rows);
+	}
+	for (size_t offset = 0; offset < buffer.size(); offset += PNG_CHUNK_BYTES)
+	{
+		size_t size = std::min(PNG_CHUNK_BYTES, buffer.size() - offset);
+		if (std::fwrite(buffer.data() + offset, 1, size, out) != size)
+		{
+			return false;
+		}
+	}
+	return std::fflush(out) == 0;
+}
+
+bool WriteToFile(const std::string &path, const std::function<bool(std::FILE *)> &write)
+{
+	fs::path file_path = fs::u8path(path);
+#ifdef _WIN32
+	std::FILE *out = _wfopen(file_path.c_str(), L"wb");
+#else
+	std::FILE *out = std::fopen(file_path.c_str(), "wb");
+#endif
+	if (!out)
+	{
+		spdlog::error("Failed to open {} for writing", path);
+		return false;
+	}
+
+	bool ok = write(out);
+	ok = std::fclose(out) == 0 && ok;
+	if (!ok)
+	{
+		std::error_code ec;
+		fs::remove(file_path, ec);
+	}
+	return ok;
+}
+
+bool SaveImage(const std::string &path, const cv::Mat &img, StitchProgress *progress, int png_compression)
+{
+	std::string ext = fs::u8path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return WriteToFile(path, [&](std::FILE *out)
+					   { return WriteImage(img, ext, out, progress, png_compression); });
+}
+
+bool WritePngRows(const std::vector<cv::Mat> &parts, std::FILE *out, int png_compression)
+{
+	return WritePng(parts, out, nullptr, png_compression);
+}
+
+bool DeflateRows(const cv::Mat &rows, int compression, std::vector<uchar> &data, DeflatedSegment &segment)
+{
+	if (rows.type() != CV_8UC3)
+	{
+		return false;
+	}
+	// 原始deflate流(无zlib头尾), 校验和单独计算以便合并时组合
+	z_stream stream{};
+	if (deflateInit2(&stream, compression, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		return false;
+	}
+	size_t row_bytes = static_cast<size_t>(rows.cols) * 3;
+	std::vector<unsigned char> rgb(row_bytes), previous(row_bytes, 0), filtered(row_bytes + 1);
+	std::vector<unsigned char> chunk(PNG_CHUNK_BYTES);
+	size_t begin = data.size();
+	uLong adler = adler32(0L, nullptr, 0);
+
+	bool ok = true;
+	auto deflate_rows = [&](int flush)
+	{
+		do
+		{
+			stream.next_out = chunk.data();
+			stream.avail_out = static_cast<uInt>(chunk.size());
+			if (deflate(&stream, flush) == Z_STREAM_ERROR)
+			{
+				return false;
+			}
+			data.insert(data.end(), chunk.data(), chunk.data() + (chunk.size() - stream.avail_out));
+		} while (stream.avail_out == 0);
+		return true;
+	};
+
+	for (int y = 0; y < rows.rows && ok; ++y)
+	{
+		FilterRow(rows.ptr<unsigned char>(y), rgb, previous, filtered, y > 0);
+		adler = adler32(adler, filtered.data(), static_cast<uInt>(filtered.size()));
+		stream.next_in = filtered.data();
+		stream.avail_in = static_cast<uInt>(filtered.size());
+		ok = deflate_rows(Z_NO_FLUSH);
+	}
+	// 完全刷新: 以字节边界结束且不设置最后块标记, 可直接与其他数据段拼接
+	ok = ok && deflate_rows(Z_FULL_FLUSH);
+	deflateEnd(&stream);
+
+	segment.data = data.data() + begin;
+	segment.size = data.size() - begin;
+	segment.raw_bytes = static_cast<uint64_t>(filtered.size()) * rows.rows;
+	segment.adler = static_cast<uint32_t>(adler);
+	return ok;
+}
+
+bool WritePngSegments(const std::vector<DeflatedSegment> &segments, int width, int height, std::FILE *out)
+{
+	if (!WritePngHeader(out, width, height))
+	{
+		return false;
+	}
+
+	// zlib头(最快压缩级别, 无预设字典)
+	static const unsigned char zlib_header[2] = {0x78, 0x01};
+	// 空的最后块(固定哈夫曼编码, 只有块结束符)
+	static const unsigned char final_block[2] = {0x03, 0x00};
+	uLong adler = adler32(0L, nullptr, 0);
+	std::vector<unsigned char> chunk;
+	chunk.reserve(PNG_CHUNK_BYTES);
+	auto append = [&](const unsigned char *data, size_t size)
+	{
+		while (size > 0)
+		{
+			size_t n = std::min(size, PNG_CHUNK_BYTES - chunk.size());
+			chunk.insert(chunk.end(), data, data + n);
+			data += n;
+			size -= n;
+			if (chunk.size() == PNG_CHUNK_BYTES)
+			{
+				if (!WriteChunk(out, "IDAT", chunk.data(), chunk.size()) || std::fflush(out) != 0)
+				{
+					return false;
+				}
+				chunk.clear();
+			}
+		}
+		return true;
+	};
+
+	bool ok = append(zlib_header, sizeof(zlib_header));
+	for (const auto &segment : segments)
+	{
+		ok = ok && append(segment.data, segment.size);
+		adler = adler32_combine64(adler, segment.adler, static_cast<z_off64_t>(segment.raw_bytes));
+	}
+	unsigned char trailer[4];
+	WriteUInt32(trailer, static_cast<uint32_t>(adler));
+	ok = ok && append(final_block, sizeof(final_block)) && append(trailer, sizeof(trailer));
+	if (ok && !chunk.empty())
+	{
+		ok = WriteChunk(out, "IDAT", chunk.data(), chunk.size());
+	}
+	return ok && WriteChunk(out, "IEND", nullptr, 0) && std::fflush(out) == 0;
+}
@@ -0,0 +1,391 @@
+#include "WatchMode.h"
+#include <spdlog/spdlog.h>
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <map>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	std::atomic<bool> g_stop{false};
+
+	void OnSignal(int)
+	{
+		g_stop = true;
+	}
+
+	fs::path NormalizePath(const std::string &path)
+	{
+		return fs::absolute(path).lexically_normal();
+	}
+}
+
+LiveSheet::LiveSheet(int cols, int margin, const OverlayOptions &overlay, const std::string &output)
+	: m_cols(cols), m_margin(margin), m_overlay(overlay), m_output(output), m_dirty_from(npos)
+{
+}
+
+void LiveSheet::Queue(const std::string &path)
+{
+	// 输出文件可能位于监视目录中
+	if (NormalizePath(path) == NormalizePath(m_output))
+	{
+		return;
+	}
+	if (std::find(m_pending.begin(), m_pending.end(), path) == m_pending.end())
+	{
+		m_pending.push_back(path);
+	}
+}
+
+void LiveSheet::Remove(const std::string &path)
+{
+	m_pending.erase(std::remove(m_pending.begin(), m_pending.end(), path), m_pending.end());
+	auto it = std::find_if(m_entries.begin(), m_entries.end(),
+						   [&](const Entry &entry) { return entry.path == path; });
+	if (it == m_entries.end())
+	{
+		return;
+	}
+
+	// 之后的图片整体前移
+	size_t index = static_cast<size_t>(it - m_entries.begin());
+	m_entries.erase(it);
+	m_dirty_from = std::min(m_dirty_from, index);
+}
+
+bool LiveSheet::HasPending() const
+{
+	return !m_pending.empty() || !m_dirty.empty() || m_dirty_from != npos;
+}
+
+bool LiveSheet::LoadEntry(Entry &entry) const
+{
+	try
+	{
+		entry.image = cv::imread(entry.path);
+		if (entry.image.empty())
+		{
+			return false;
+		}
+		if (m_overlay.datetime)
+		{
+			entry.date_time = FileDateTime(entry.path);
+		}
+		// 在未绘制的原图上检测文本框, 结果随图片一起缓存
+		if (m_overlay.mosaic && !FindLineEdit(entry.image, entry.lineedit, m_overlay.profile))
+		{
+			spdlog::warn("Failed to find lineedit: {}", entry.path);
+		}
+		return true;
+	}
+	catch (const std::exception &e)
+	{
+		spdlog::error("Error loading {}: {}", entry.path, e.what());
+		entry.image.release();
+		return false;
+	}
+}
+
+bool LiveSheet::Flush()
+{
+	// 1. 并行解码新增/修改的图片
+	std::vector<Entry> loaded(m_pending.size());
+	auto load = [&](const cv::Range &range)
+	{
+		for (int i = range.start; i < range.end; ++i)
+		{
+			loaded[i].path = m_pending[i];
+			LoadEntry(loaded[i]);
+		}
+	};
+	cv::parallel_for_(cv::Range(0, static_cast<int>(m_pending.size())), load);
+	m_pending.clear();
+
+	for (auto &entry : loaded)
+	{
+		if (entry.image.empty())
+		{
+			spdlog::error("Failed to load image: {}", entry.path);
+			continue;
+		}
+		auto it = std::find_if(m_entries.begin(), m_entries.end(),
+							   [&](const Entry &existing) { return existing.path == entry.path; });
+		if (it != m_entries.end())
+		{
+			m_dirty.insert(static_cast<size_t>(it - m_entries.begin()));
+			*it = std::move(entry);
+		}
+		else
+		{
+			m_dirty.insert(m_entries.size());
+			m_entries.push_back(std::move(entry));
+		}
+	}
+
+	if (m_entries.empty())
+	{
+		m_dirty.clear();
+		m_dirty_from = npos;
+		spdlog::info("No images to stitch yet");
+		return true;
+	}
+
+	// 2. 计算布局, 列数固定时只增加行数
+	std::vector<cv::Size> sizes;
+	for (const auto &entry : m_entries)
+	{
+		sizes.push_back(entry.image.size());
+	}
+	int rows = m_cols > 0 ? static_cast<int>(std::ceil(static_cast<double>(m_entries.size()) / m_cols)) : 0;
+	GridLayout layout = ComputeGridLayout(sizes, rows, m_cols, m_margin);
+
+	std::set<int> dirty_rows;
+	bool relayout = m_canvas.empty() || layout.cols != m_layout.cols ||
+					layout.cell_width != m_layout.cell_width || layout.cell_height != m_layout.cell_height;
+	if (relayout)
+	{
+		// 单元格尺寸或列数变化, 全部重新合成(使用缓存的图片, 无需重新解码)
+		m_canvas = cv::Mat(layout.CanvasSize(), CV_8UC3, cv::Scalar(255, 255, 255));
+		for (int row = 0; row < layout.rows; ++row)
+		{
+			dirty_rows.insert(row);
+		}
+	}
+	else
+	{
+		if (layout.rows != m_layout.rows)
+		{
+			// 行数变化, 保留未受影响的行
+			cv::Mat canvas(layout.CanvasSize(), CV_8UC3, cv::Scalar(255, 255, 255));
+			int keep = std::min(canvas.rows, m_canvas.rows);
+			m_canvas.rowRange(0, keep).copyTo(canvas.rowRange(0, keep));
+			m_canvas = canvas;
+		}
+		for (size_t index : m_dirty)
+		{
+			if (index < m_entries.size())
+			{
+				dirty_rows.insert(static_cast<int>(index / layout.cols));
+			}
+		}
+		if (m_dirty_from != npos)
+		{
+			for (int row = static_cast<int>(m_dirty_from / layout.cols); row < layout.rows; ++row)
+			{
+				dirty_rows.insert(row);
+			}
+		}
+	}
+	m_layout = layout;
+	m_dirty.clear();
+	m_dirty_from = npos;
+
+	// 3. 重新合成受影响的行
+	for (int row : dirty_rows)
+	{
+		RecomposeRow(row);
+	}
+	spdlog::info("Recomposed {} of {} rows ({} images)", dirty_rows.size(), m_layout.rows, m_entries.size());
+
+	return Save();
+}
+
+void LiveSheet::RecomposeRow(int row)
+{
+	cv::Rect row_rect(0, row * (m_layout.cell_height + m_layout.margin), m_canvas.cols, m_layout.cell_height);
+	m_canvas(row_rect).setTo(cv::Scalar(255, 255, 255));
+
+	size_t begin = static_cast<size_t>(row) * m_layout.cols;
+	size_t end = std::min(begin + m_layout.cols, m_entries.size());
+	if (begin >= end)
+	{
+		return;
+	}
+	auto paste = [&](const cv::Range &range)
+	{
+		for (int i = range.start; i < range.end; ++i)
+		{
+			const Entry &entry = m_entries[i];
+			cv::Mat cell = m_canvas(m_layout.ImageRect(i, entry.image.size()));
+			entry.image.copyTo(cell);
+			if (m_overlay.sequence)
+			{
+				DrawSequence(cell, i);
+			}
+			if (m_overlay.datetime)
+			{
+				DrawDateTime(cell, entry.date_time);
+			}
+			if (m_overlay.mosaic && !entry.lineedit.empty())
+			{
+				DrawMosaic(cell, entry.lineedit, m_overlay.profile);
+			}
+		}
+	};
+	cv::parallel_for_(cv::Range(static_cast<int>(begin), static_cast<int>(end)), paste);
+}
+
+bool LiveSheet::Save() const
+{
+	// 先写入临时文件再替换, 避免查看者读到不完整的图片
+	fs::path output(m_output);
+	fs::path temp = output.parent_path() / ("." + output.stem().string() + ".tmp" + output.extension().string());
+	if (!cv::imwrite(temp.string(), m_canvas))
+	{
+		spdlog::error("Failed to save image to {}", temp.string());
+		return false;
+	}
+	std::error_code ec;
+	fs::rename(temp, output, ec);
+	if (ec)
+	{
+		spdlog::error("Failed to replace {}: {}", m_output, ec.message());
+		return false;
+	}
+	spdlog::info("Saved {}", m_output);
+	return true;
+}
+
+bool WatchImages(const std::vector<std::string> &dirs, LiveSheet &sheet, int debounce_ms)
+{
+#ifdef __linux__
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+	{
+		spdlog::error("Failed to initialize inotify: {}", std::strerror(errno));
+		return false;
+	}
+
+	std::map<int, std::string> watches;
+	for (const auto &dir : dirs)
+	{
+		int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+		if (wd < 0)
+		{
+			spdlog::error("Failed to watch {}: {}", dir, std::strerror(errno));
+			continue;
+		}
+		watches[wd] = dir;
+		spdlog::info("Watching {}", dir);
+	}
+	if (watches.empty())
+	{
+		close(fd);
+		return false;
+	}
+
+	// 监视建立后再扫描一遍目录并完成首次拼接, 扫描与首次拼接期间新增的图片不会遗漏
+	for (const auto &[wd, dir] : watches)
+	{
+		std::error_code ec;
+		for (const auto &entry : fs::directory_iterator(dir, ec))
+		{
+			if (entry.is_regular_file() && IsImageFile(entry.path().string()) && entry.path().filename().string()[0] != '.')
+			{
+				sheet.Queue(entry.path().string());
+			}
+		}
+	}
+	if (!sheet.Flush())
+	{
+		close(fd);
+		return false;
+	}
+
+	std::signal(SIGINT, OnSignal);
+	std::signal(SIGTERM, OnSignal);
+
+	alignas(inotify_event) char buffer[64 * 1024];
+	auto last_event = std::chrono::steady_clock::now();
+	bool success = true;
+	while (!g_stop)
+	{
+		// 有待处理的变化时, 最后一次事件之后静默debounce_ms再更新
+		int timeout = -1;
+		if (sheet.HasPending())
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last_event).count();
+			timeout = static_cast<int>(std::max<long long>(0, debounce_ms - elapsed));
+		}
+
+		pollfd pfd{fd, POLLIN, 0};
+		int ready = poll(&pfd, 1, timeout);
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			spdlog::error("Failed to poll inotify: {}", std::strerror(errno));
+			success = false;
+			break;
+		}
+		if (ready == 0)
+		{
+			sheet.Flush();
+			continue;
+		}
+
+		ssize_t length;
+		while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char *p = buffer; p < buffer + length;)
+			{
+				const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+				p += sizeof(inotify_event) + event->len;
+
+				// 忽略目录、隐藏文件(包括输出的临时文件)和非图片文件
+				if (event->len == 0 || (event->mask & IN_ISDIR) || event->name[0] == '.')
+				{
+					continue;
+				}
+				std::string path = (fs::path(watches[event->wd]) / event->name).string();
+				if (!IsImageFile(path))
+				{
+					continue;
+				}
+
+				if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+				{
+					spdlog::debug("Removed: {}", path);
+					sheet.Remove(path);
+				}
+				else
+				{
+					spdlog::debug("Changed: {}", path);
+					sheet.Queue(path);
+				}
+				last_event = std::chrono::steady_clock::now();
+			}
+		}
+	}
+	close(fd);
+
+	if (sheet.HasPending())
+	{
+		sheet.Flush();
+	}
+	return success;
+#else
+	(void)dirs;
+	(void)sheet;
+	(void)debounce_ms;
+	spdlog::error("Watch mode requires inotify and is only supported on Linux");
+	return false;
+#endif
+}
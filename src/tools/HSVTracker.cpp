@@ -0,0 +1,182 @@
+#include "DetectionProfile.h"
+#include "ImageGrid.h"
+#include <spdlog/spdlog.h>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cxxopts.hpp>
+
+// HSV阈值调试工具: 拖动滑块时在缩小的预览图上重新计算掩码, 按键在原图上检测并导出检测配置
+namespace
+{
+	const char *WINDOW_TRACKBARS = "trackbars";
+	const char *WINDOW_IMAGE = "image";
+	const char *WINDOW_MASK = "img_mask";
+	const char *WINDOW_DETECTION = "detection";
+
+	struct TrackerState
+	{
+		cv::Mat img;
+		cv::Mat preview;
+		cv::Mat preview_hsv;
+		double scale = 1.0;
+		DetectionProfile profile;
+		bool ready = false;
+	};
+
+	// 按预览比例缩小后显示
+	void ShowScaled(const char *window, const cv::Mat &img, double scale)
+	{
+		if (scale >= 1.0)
+		{
+			cv::imshow(window, img);
+			return;
+		}
+		cv::Mat scaled;
+		cv::resize(img, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+		cv::imshow(window, scaled);
+	}
+
+	// 滑块回调, 只在数值变化时触发
+	void OnTrackbar(int, void *userdata)
+	{
+		TrackerState &state = *static_cast<TrackerState *>(userdata);
+		if (!state.ready)
+		{
+			return;
+		}
+
+		DetectionProfile &profile = state.profile;
+		profile.hsv_lower = cv::Scalar(cv::getTrackbarPos("Hue Min", WINDOW_TRACKBARS),
+									   cv::getTrackbarPos("Sat Min", WINDOW_TRACKBARS),
+									   cv::getTrackbarPos("Val Min", WINDOW_TRACKBARS));
+		profile.hsv_upper = cv::Scalar(cv::getTrackbarPos("Hue Max", WINDOW_TRACKBARS),
+									   cv::getTrackbarPos("Sat Max", WINDOW_TRACKBARS),
+									   cv::getTrackbarPos("Val Max", WINDOW_TRACKBARS));
+		profile.max_aspect_ratio = std::max(1, cv::getTrackbarPos("Aspect Max", WINDOW_TRACKBARS));
+		profile.mosaic = cv::Rect(cv::getTrackbarPos("Mosaic X", WINDOW_TRACKBARS),
+								  cv::getTrackbarPos("Mosaic Y", WINDOW_TRACKBARS),
+								  std::max(1, cv::getTrackbarPos("Mosaic W", WINDOW_TRACKBARS)),
+								  std::max(1, cv::getTrackbarPos("Mosaic H", WINDOW_TRACKBARS)));
+
+		cv::Mat img_mask;
+		cv::inRange(state.preview_hsv, profile.hsv_lower, profile.hsv_upper, img_mask);
+		cv::imshow(WINDOW_MASK, img_mask);
+	}
+
+	void CreateTrackbar(const char *name, int value, int max, TrackerState &state)
+	{
+		cv::createTrackbar(name, WINDOW_TRACKBARS, nullptr, max, OnTrackbar, &state);
+		cv::setTrackbarPos(name, WINDOW_TRACKBARS, value);
+	}
+
+	// 在原图上按当前配置检测文本框并打码
+	void Refine(const TrackerState &state)
+	{
+		cv::Mat result = state.img.clone();
+		cv::Rect rect_target;
+		if (!FindLineEdit(state.img, rect_target, state.profile))
+		{
+			spdlog::warn("No lineedit found at full resolution");
+			ShowScaled(WINDOW_DETECTION, result, state.scale);
+			return;
+		}
+		spdlog::info("Lineedit: x={} y={} w={} h={}", rect_target.x, rect_target.y, rect_target.width, rect_target.height);
+
+		DrawMosaic(result, rect_target, state.profile);
+		cv::rectangle(result, rect_target, cv::Scalar(255, 0, 255), 3);
+		cv::rectangle(result,
+					  cv::Rect(rect_target.x + state.profile.mosaic.x, rect_target.y + state.profile.mosaic.y,
+							   state.profile.mosaic.width, state.profile.mosaic.height),
+					  cv::Scalar(0, 255, 0), 2);
+		ShowScaled(WINDOW_DETECTION, result, state.scale);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	cxxopts::Options options(argv[0], "Tune the lineedit detection profile");
+	options.add_options()
+		("image", "Screenshot to tune against", cxxopts::value<std::string>())
+		("o,output", "Profile to export", cxxopts::value<std::string>()->default_value("detection_profile.yml"))
+		("p,profile", "Profile to start from", cxxopts::value<std::string>())
+		("preview-width", "Width of the preview window", cxxopts::value<int>()->default_value("720"))
+		("h,help", "Print help");
+	options.parse_positional({"image"});
+	options.positional_help("<image>");
+
+	auto result = options.parse(argc, argv);
+	if (result.count("help") || !result.count("image"))
+	{
+		spdlog::info(options.help());
+		return result.count("help") ? 0 : 1;
+	}
+
+	TrackerState state;
+	state.img = cv::imread(result["image"].as<std::string>());
+	if (state.img.empty())
+	{
+		spdlog::error("Failed to load image");
+		return 1;
+	}
+	if (result.count("profile") && !state.profile.Load(result["profile"].as<std::string>()))
+	{
+		return 1;
+	}
+	std::string output = result["output"].as<std::string>();
+
+	// 转换为hsv, 与FindLineEdit使用相同的通道顺序
+	state.scale = std::min(1.0, static_cast<double>(result["preview-width"].as<int>()) / state.img.cols);
+	cv::resize(state.img, state.preview, cv::Size(), state.scale, state.scale, cv::INTER_AREA);
+	cv::cvtColor(state.preview, state.preview_hsv, cv::COLOR_RGB2HSV);
+
+	const DetectionProfile initial = state.profile;
+	cv::namedWindow(WINDOW_TRACKBARS);
+	CreateTrackbar("Hue Min", static_cast<int>(initial.hsv_lower[0]), 179, state);
+	CreateTrackbar("Hue Max", static_cast<int>(initial.hsv_upper[0]), 179, state);
+	CreateTrackbar("Sat Min", static_cast<int>(initial.hsv_lower[1]), 255, state);
+	CreateTrackbar("Sat Max", static_cast<int>(initial.hsv_upper[1]), 255, state);
+	CreateTrackbar("Val Min", static_cast<int>(initial.hsv_lower[2]), 255, state);
+	CreateTrackbar("Val Max", static_cast<int>(initial.hsv_upper[2]), 255, state);
+	CreateTrackbar("Aspect Max", initial.max_aspect_ratio, 100, state);
+	CreateTrackbar("Mosaic X", initial.mosaic.x, 500, state);
+	CreateTrackbar("Mosaic Y", initial.mosaic.y, 200, state);
+	CreateTrackbar("Mosaic W", initial.mosaic.width, 500, state);
+	CreateTrackbar("Mosaic H", initial.mosaic.height, 200, state);
+	state.ready = true;
+
+	cv::imshow(WINDOW_IMAGE, state.preview);
+	OnTrackbar(0, &state);
+	spdlog::info("f: detect at full resolution, s: save profile to {}, q/Esc: quit", output);
+
+	// 阻塞等待按键, 滑块事件在等待期间由回调处理
+	while (true)
+	{
+		int key = cv::waitKey(0);
+		if (key < 0)
+		{
+			if (cv::getWindowProperty(WINDOW_TRACKBARS, cv::WND_PROP_VISIBLE) < 1)
+			{
+				break;
+			}
+			continue;
+		}
+
+		key &= 0xFF;
+		if (key == 'f')
+		{
+			Refine(state);
+		}
+		else if (key == 's')
+		{
+			state.profile.Save(output);
+		}
+		else if (key == 'q' || key == 27)
+		{
+			break;
+		}
+	}
+	cv::destroyAllWindows();
+	return 0;
+}
@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+# 对比各程序的启动耗时: 以 --help 运行(只解析参数, 不做任何处理), 输出每次运行的平均耗时
+# 用法: tools/startup_time.sh bin/ImgStitcherCli bin/ImgStitcher
+# 环境变量 RUNS 指定运行次数(默认50)
+set -euo pipefail
+
+runs=${RUNS:-50}
+
+for bin in "$@"; do
+    # 预热, 排除首次读取磁盘的影响
+    "$bin" --help >/dev/null 2>&1 || true
+
+    start=$(date +%s%N)
+    for ((i = 0; i < runs; ++i)); do
+        "$bin" --help >/dev/null 2>&1 || true
+    done
+    end=$(date +%s%N)
+
+    libs=""
+    if command -v ldd >/dev/null 2>&1; then
+        libs=", $(ldd "$bin" | wc -l) shared libraries"
+    fi
+    echo "$(basename "$bin"): $(((end - start) / runs / 1000)) us/run over ${runs} runs${libs}"
+done